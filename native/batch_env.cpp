@@ -0,0 +1,239 @@
+#include "batch_env.h"
+
+#include <array>
+#include <barrier>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "referee.hpp"
+
+namespace {
+
+using common::u64;
+
+using referee::N;
+using referee::M;
+using referee::Board;
+
+constexpr u64 OBSERVATION_PLANES = 7;
+constexpr u64 OBSERVATION_WORDS = OBSERVATION_PLANES * Board::WORDS;
+
+// games of one thread start at a multiple of this (no false sharing of byte arrays)
+constexpr u64 CHUNK_ALIGN = 64;
+
+/**
+ * @brief Threads that run one job together, the caller is worker 0.
+ * Workers sleep on a barrier between jobs, so an idle env costs nothing.
+ */
+class WorkerPool {
+private:
+	u64 count;
+	std::function<void(u64)> job;
+	bool stopping = false;
+	std::barrier<> start;
+	std::barrier<> finish;
+	std::vector<std::thread> workers;
+
+	void work(u64 id) {
+		while (true) {
+			start.arrive_and_wait();
+			if (stopping) {
+				return;
+			}
+			job(id);
+			finish.arrive_and_wait();
+		}
+	}
+
+public:
+	explicit WorkerPool(u64 count)
+		: count(count), start(count), finish(count) {
+		for (u64 id = 1; id < count; id++) {
+			workers.emplace_back([this, id] { work(id); });
+		}
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	~WorkerPool() {
+		if (count > 1) {
+			stopping = true;
+			start.arrive_and_wait();
+		}
+		for (auto& worker: workers) {
+			worker.join();
+		}
+	}
+
+	u64 size() const {
+		return count;
+	}
+
+	template <typename F>
+	void run(F f) {
+		if (count == 1) {
+			f(0);
+			return;
+		}
+		job = f;
+		start.arrive_and_wait();
+		f(0);
+		finish.arrive_and_wait();
+	}
+};
+
+}
+
+/**
+ * @brief Structure of arrays: field k of game i is fields[k][i],
+ * so a step streams through each array once.
+ */
+struct OffBatchEnv {
+	u64 games;
+	u64 n;
+	u64 m;
+	u64 wall_count;
+	u64 max_rounds;
+
+	std::vector<Board> walls;
+	std::array<std::vector<Board>, 4> blocked;
+	std::array<std::vector<Board>, 4> bullets;
+	std::vector<uint16_t> red;
+	std::vector<uint16_t> blue;
+	std::vector<uint32_t> rounds;
+	std::vector<uint8_t> done;
+
+	std::unique_ptr<WorkerPool> pool;
+
+	OffBatchEnv(u64 games, u64 n, u64 m, u64 wall_count, u64 max_rounds, u64 threads)
+		: games(games), n(n), m(m), wall_count(wall_count), max_rounds(max_rounds),
+		  walls(games), red(games), blue(games), rounds(games), done(games, 1),
+		  pool(std::make_unique<WorkerPool>(threads)) {
+		for (u64 dir = 0; dir < 4; dir++) {
+			blocked[dir].resize(games);
+			bullets[dir].resize(games);
+		}
+	}
+
+	/**
+	 * @brief Games [begin, end) of a worker.
+	 */
+	std::pair<u64, u64> chunk(u64 id) const {
+		auto bound = [&](u64 k) {
+			const u64 raw = games * k / pool->size();
+			return std::min(games, (raw + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN);
+		};
+		return {bound(id), bound(id + 1)};
+	}
+
+	void resetGame(u64 i, u64 seed) {
+		walls[i] = referee::generateWalls(seed, n, m, wall_count);
+		const referee::Planes blk = referee::blockedPlanes(walls[i]);
+		for (u64 dir = 0; dir < 4; dir++) {
+			blocked[dir][i] = blk[dir];
+			bullets[dir][i].clear();
+		}
+		red[i]  = Board::index(1, 1);
+		blue[i] = Board::index(n - 2, m - 2);
+		rounds[i] = 0;
+		done[i] = 0;
+	}
+
+	/**
+	 * @brief Same rules as GameLogic.applyMove (see referee::applyMove).
+	 */
+	uint8_t stepGame(u64 i, u64 red_move, u64 blue_move) {
+		referee::Planes b = {bullets[0][i], bullets[1][i], bullets[2][i], bullets[3][i]};
+		const referee::Planes blk = {blocked[0][i], blocked[1][i], blocked[2][i], blocked[3][i]};
+		u64 red_cell  = red[i];
+		u64 blue_cell = blue[i];
+
+		const uint8_t hits = referee::applyMove(blk, b, red_cell, blue_cell, red_move, blue_move);
+		if (red_move >= referee::SURRENDER or blue_move >= referee::SURRENDER) {
+			done[i] = 1;
+			return hits;
+		}
+
+		for (u64 dir = 0; dir < 4; dir++) {
+			bullets[dir][i] = b[dir];
+		}
+		red[i]  = red_cell;
+		blue[i] = blue_cell;
+		rounds[i]++;
+		done[i] = hits != 0 or (max_rounds != 0 and rounds[i] >= max_rounds);
+		return hits;
+	}
+
+	void observeGame(u64 i, uint64_t* out) const {
+		const Board* planes[OBSERVATION_PLANES - 2] = {
+			&walls[i], &bullets[0][i], &bullets[1][i], &bullets[2][i], &bullets[3][i],
+		};
+		for (u64 k = 0; k < OBSERVATION_PLANES - 2; k++) {
+			std::memcpy(out + k * Board::WORDS, planes[k]->words.data(), 8 * Board::WORDS);
+		}
+		Board player;
+		player.set(red[i]);
+		std::memcpy(out + 5 * Board::WORDS, player.words.data(), 8 * Board::WORDS);
+		player.clear();
+		player.set(blue[i]);
+		std::memcpy(out + 6 * Board::WORDS, player.words.data(), 8 * Board::WORDS);
+	}
+};
+
+extern "C" {
+
+OffBatchEnv* off_env_create(uint32_t games, uint32_t n, uint32_t m, uint32_t wall_count,
+                            uint32_t max_rounds, uint32_t threads) {
+	if (games == 0 or n < 3 or m < 3 or n > N or m > M or threads == 0) {
+		return nullptr;
+	}
+	return new OffBatchEnv(games, n, m, wall_count, max_rounds, threads);
+}
+
+void off_env_destroy(OffBatchEnv* env) {
+	delete env;
+}
+
+void off_env_reset(OffBatchEnv* env, const uint64_t* seeds, const uint8_t* mask) {
+	env->pool->run([&](u64 id) {
+		auto [begin, end] = env->chunk(id);
+		for (u64 i = begin; i < end; i++) {
+			if (mask == nullptr or mask[i] != 0) {
+				env->resetGame(i, seeds[i]);
+			}
+		}
+	});
+}
+
+void off_env_step(OffBatchEnv* env, const uint8_t* moves, uint8_t* hits, uint8_t* done) {
+	env->pool->run([&](u64 id) {
+		auto [begin, end] = env->chunk(id);
+		for (u64 i = begin; i < end; i++) {
+			hits[i] = env->done[i] ? 0 : env->stepGame(i, moves[2 * i], moves[2 * i + 1]);
+			done[i] = env->done[i];
+		}
+	});
+}
+
+uint64_t off_env_observation_words(void) {
+	return OBSERVATION_WORDS;
+}
+
+void off_env_observe(const OffBatchEnv* env, uint64_t* out) {
+	env->pool->run([&](u64 id) {
+		auto [begin, end] = env->chunk(id);
+		for (u64 i = begin; i < end; i++) {
+			env->observeGame(i, out + i * OBSERVATION_WORDS);
+		}
+	});
+}
+
+void off_env_rounds(const OffBatchEnv* env, uint32_t* out) {
+	std::memcpy(out, env->rounds.data(), 4 * env->games);
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+/**
+ * Batched environment: many independent games stepped in lockstep.
+ * C ABI, so it can be loaded with ctypes (see batch_env.py) or linked from C/C++.
+ *
+ * Games are seen from the referee side: move[2 * i] is red, move[2 * i + 1] is blue,
+ * moves are MoveProfile values (0-3 go, 4-7 shoot, 8 wait, anything else surrenders).
+ * hits[i]: bit 0 -- red is hit (or surrendered), bit 1 -- blue is.
+ * done[i]: game ended (hit, surrender or round limit), it is not stepped until reset.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct OffBatchEnv OffBatchEnv;
+
+/**
+ * @param games number of games
+ * @param n, m board size (at most 20 x 30)
+ * @param wall_count approximated wall count, as in GameLogic
+ * @param max_rounds round after which a game is done (tie), 0 means no limit
+ * @param threads worker threads for step and reset (1 -- only the caller)
+ * @return NULL on invalid parameters
+ */
+OffBatchEnv* off_env_create(uint32_t games, uint32_t n, uint32_t m, uint32_t wall_count,
+                            uint32_t max_rounds, uint32_t threads);
+
+void off_env_destroy(OffBatchEnv* env);
+
+/**
+ * @brief New games from seeds[games] (same seed -- same map).
+ * @param mask if not NULL only games with mask[i] != 0 are reset
+ */
+void off_env_reset(OffBatchEnv* env, const uint64_t* seeds, const uint8_t* mask);
+
+/**
+ * @brief One round of every not done game.
+ * @param moves games * 2 moves
+ * @param hits, done games bytes each, written for every game
+ */
+void off_env_step(OffBatchEnv* env, const uint8_t* moves, uint8_t* hits, uint8_t* done);
+
+/**
+ * @brief Number of u64 words of one game observation:
+ * 7 planes (walls, up, down, left, right bullets, red, blue), cell (i, j) is bit i * 30 + j
+ * of the plane (planes have 10 words each).
+ */
+uint64_t off_env_observation_words(void);
+
+/**
+ * @brief Writes observations of all games straight into out[games * off_env_observation_words()].
+ */
+void off_env_observe(const OffBatchEnv* env, uint64_t* out);
+
+/**
+ * @brief Rounds played by every game, written to out[games].
+ */
+void off_env_rounds(const OffBatchEnv* env, uint32_t* out);
+
+#ifdef __cplusplus
+}
+#endif
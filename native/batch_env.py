@@ -0,0 +1,84 @@
+# Thin ctypes binding of the batched environment (libbatchenv.so, build with `make` here).
+# Buffers are passed by pointer: anything writable with the buffer protocol
+# (numpy array, bytearray, array.array) is used in place, without copies.
+
+import ctypes
+import os
+from typing import Tuple
+
+LIBRARY_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libbatchenv.so")
+
+def _buffer(buffer, item_size: int, count: int, writable: bool = False):
+	"""ctypes view of a buffer protocol object, checked to hold `count` items of `item_size` bytes."""
+	view = memoryview(buffer).cast("B")
+	if view.nbytes < count * item_size:
+		raise ValueError(f"buffer too small: {view.nbytes} bytes, need {count * item_size}")
+	if view.readonly:
+		if writable:
+			raise ValueError("buffer is read only")
+		# (e.g. bytes) -- the only case with a copy:
+		return (ctypes.c_char * view.nbytes).from_buffer_copy(view)
+	return (ctypes.c_char * view.nbytes).from_buffer(view)
+
+def _load(path: str):
+	lib = ctypes.CDLL(path)
+	lib.off_env_create.restype = ctypes.c_void_p
+	lib.off_env_create.argtypes = [ctypes.c_uint32] * 6
+	lib.off_env_destroy.argtypes = [ctypes.c_void_p]
+	lib.off_env_reset.argtypes = [ctypes.c_void_p] * 3
+	lib.off_env_step.argtypes = [ctypes.c_void_p] * 4
+	lib.off_env_observation_words.restype = ctypes.c_uint64
+	lib.off_env_observe.argtypes = [ctypes.c_void_p] * 2
+	lib.off_env_rounds.argtypes = [ctypes.c_void_p] * 2
+	return lib
+
+class BatchEnv:
+	"""
+	`games` independent games stepped together (see batch_env.h for the rules).
+	step() returns views of internal buffers, valid until the next step.
+	"""
+
+	def __init__(self, games: int, n: int = 20, m: int = 30, wall_count: int = 30,
+	             max_rounds: int = 100, threads: int = 1, library: str = LIBRARY_PATH):
+		self.lib = _load(library)
+		self.games = games
+		self.env = self.lib.off_env_create(games, n, m, wall_count, max_rounds, threads)
+		if not self.env:
+			raise ValueError("invalid environment parameters")
+		self.observation_words = self.lib.off_env_observation_words()
+		self.hits = bytearray(games)
+		self.done = bytearray(games)
+		self.hits_buffer = _buffer(self.hits, 1, games, True)
+		self.done_buffer = _buffer(self.done, 1, games, True)
+
+	def close(self):
+		if self.env:
+			self.lib.off_env_destroy(self.env)
+			self.env = None
+
+	def __del__(self):
+		self.close()
+
+	def reset(self, seeds, mask = None):
+		"""seeds: `games` u64 values (e.g. array.array("Q")), mask: optional `games` bytes."""
+		mask_buffer = None if mask is None else _buffer(mask, 1, self.games)
+		self.lib.off_env_reset(self.env, _buffer(seeds, 8, self.games), mask_buffer)
+
+	def step(self, moves) -> Tuple[memoryview, memoryview]:
+		"""moves: 2 * `games` bytes (red, blue for every game). Returns (hits, done)."""
+		self.lib.off_env_step(self.env, _buffer(moves, 1, 2 * self.games),
+		                      self.hits_buffer, self.done_buffer)
+		return memoryview(self.hits), memoryview(self.done)
+
+	def observe(self, out = None):
+		"""Writes observations into out (`games * observation_words` u64), allocated if None."""
+		if out is None:
+			out = bytearray(8 * self.games * self.observation_words)
+		self.lib.off_env_observe(self.env, _buffer(out, 8, self.games * self.observation_words, True))
+		return out
+
+	def rounds(self, out = None):
+		if out is None:
+			out = bytearray(4 * self.games)
+		self.lib.off_env_rounds(self.env, _buffer(out, 4, self.games, True))
+		return out
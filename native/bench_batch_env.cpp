@@ -0,0 +1,71 @@
+// Aggregate steps/s of the batched environment for growing thread counts.
+// Games play random moves (mostly go and wait, some shots) and are reset when done.
+// Only steps of games that were not done count (done games are skipped by off_env_step).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "batch_env.h"
+
+namespace {
+
+constexpr uint32_t GAMES = 1 << 14;
+constexpr double MIN_SECONDS = 1.0;
+
+double stepsPerSecond(uint32_t threads) {
+	using Clock = std::chrono::steady_clock;
+	OffBatchEnv* env = off_env_create(GAMES, 20, 30, 30, 100, threads);
+
+	std::vector<uint64_t> seeds(GAMES);
+	for (uint32_t i = 0; i < GAMES; i++) {
+		seeds[i] = i;
+	}
+	off_env_reset(env, seeds.data(), nullptr);
+
+	// a pool of random moves, the benchmark measures the env, not the move generation:
+	std::vector<uint8_t> moves(2 * GAMES * 16);
+	uint64_t state = 12345;
+	for (auto& move: moves) {
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		move = (state >> 33) % 9;
+	}
+	std::vector<uint8_t> hits(GAMES), done(GAMES);
+
+	uint64_t steps = 0;
+	uint64_t round = 0;
+	const auto start = Clock::now();
+	double seconds = 0;
+	while (seconds < MIN_SECONDS) {
+		for (auto game_done: done) {
+			steps += not game_done;
+		}
+		off_env_step(env, moves.data() + 2 * GAMES * (round % 16), hits.data(), done.data());
+		round++;
+		if (round % 8 == 0) {
+			for (uint32_t i = 0; i < GAMES; i++) {
+				seeds[i] += GAMES;
+			}
+			off_env_reset(env, seeds.data(), done.data());
+			std::fill(done.begin(), done.end(), 0);
+		}
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	off_env_destroy(env);
+	return steps / seconds;
+}
+
+}
+
+// usage: bench_batch_env [max threads] (default: all cores)
+int main(int argc, char** argv) {
+	const uint32_t max_threads = argc > 1 ? std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+	std::printf("games: %u\n", GAMES);
+	for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+		std::printf("threads %3u: %7.2f M steps/s\n", threads, stepsPerSecond(threads) / 1e6);
+	}
+}
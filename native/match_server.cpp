@@ -0,0 +1,926 @@
+// Match server: many games (exec vs exec) in one process, over one epoll loop.
+//
+// Usage: match_server [options] [JOBS_FILE]   (jobs are read from stdin without JOBS_FILE)
+//   -g, --games N          concurrent games (default: half of the cores, both bots of a game think at once)
+//   -t, --timeout MS       time limit of one move (default 500)
+//   --match-budget MS      total time of all moves of one player, 0 means no budget (default 0)
+//   --round-count N        rounds after which there is a tie (default 100)
+//   --protocol full|delta  exec protocol, as in python_impl/internal/runner.py (default full)
+//   --state-format text|binary
+//
+// Job line: "<id> <red exec> <blue exec> [seed] [n] [m] [wall_count]", defaults: line number, 20, 30, 30.
+// Empty lines and lines starting with '#' are skipped. Jobs may keep coming while games run.
+// Result line (stdout, as soon as the game ends): "<id> <RED|BLUE|TIE> <rounds>",
+// or "<id> ERROR <reason>" for an invalid job. Warnings go to stderr.
+//
+// Rules come from referee.hpp, so maps of a seed differ from the Python referee.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "referee.hpp"
+
+extern char** environ;
+
+namespace {
+
+using referee::u64;
+using referee::i64;
+
+enum class Protocol { FULL, DELTA };
+enum class StateFormat { TEXT, BINARY };
+
+struct Options {
+	u64 games = std::max(1u, std::thread::hardware_concurrency() / 2);
+	u64 timeout_ms = 500;
+	u64 match_budget_ms = 0;
+	u64 round_count = 100;
+	Protocol protocol = Protocol::FULL;
+	StateFormat state_format = StateFormat::TEXT;
+	const char* jobs_path = nullptr;
+};
+
+struct Job {
+	std::string id;
+	std::array<std::string, 2> execs;
+	u64 seed = 0;
+	u64 n = 20;
+	u64 m = 30;
+	u64 wall_count = 30;
+};
+
+u64 nowMs() {
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Hashed timing wheel with 1 ms ticks, driven by a periodic timerfd
+ * that only runs while some timer is pending.
+ * Timers are not removed, their owners ignore stale ones (see Bot::timer_serial).
+ */
+class TimerWheel {
+private:
+	static constexpr u64 SLOTS = 1024;
+
+	struct Entry {
+		u64 deadline;
+		u64 token;
+	};
+
+	int fd;
+	u64 current;
+	u64 pending = 0;
+	std::array<std::vector<Entry>, SLOTS> slots;
+
+	void arm(bool on) {
+		itimerspec spec = {};
+		if (on) {
+			spec.it_interval.tv_nsec = 1'000'000;
+			spec.it_value.tv_nsec = 1'000'000;
+		}
+		timerfd_settime(fd, 0, &spec, nullptr);
+	}
+
+public:
+	TimerWheel()
+		: fd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)), current(nowMs()) {}
+
+	int descriptor() const {
+		return fd;
+	}
+
+	void add(u64 deadline, u64 token) {
+		// ticks up to `current` are already scanned:
+		deadline = std::max(deadline, current + 1);
+		slots[deadline % SLOTS].push_back({deadline, token});
+		if (pending++ == 0) {
+			arm(true);
+		}
+	}
+
+	/**
+	 * @brief Fires timers with deadline <= now (call after the timerfd is readable).
+	 */
+	template <typename F>
+	void advance(F fire) {
+		uint64_t expirations;
+		[[maybe_unused]] auto got = ::read(fd, &expirations, sizeof(expirations));
+
+		const u64 now = nowMs();
+		const u64 first = std::max(current + 1, now >= SLOTS ? now - SLOTS + 1 : 0);
+		std::vector<u64> fired;
+		for (u64 tick = first; tick <= now and pending > 0; tick++) {
+			auto& slot = slots[tick % SLOTS];
+			for (u64 k = 0; k < slot.size();) {
+				if (slot[k].deadline <= now) {
+					fired.push_back(slot[k].token);
+					slot[k] = slot.back();
+					slot.pop_back();
+					pending--;
+				} else {
+					k++;
+				}
+			}
+		}
+		current = now;
+		if (pending == 0) {
+			arm(false);
+		}
+		// after the scan, as firing may add timers:
+		for (u64 token: fired) {
+			fire(token);
+		}
+	}
+};
+
+// epoll tokens: kind in the low bits, then player, game slot and serial of the process
+enum TokenKind : u64 {
+	TOKEN_JOBS   = 0,
+	TOKEN_TIMER  = 1,
+	TOKEN_SIGNAL = 2,
+	TOKEN_STDIN  = 3, // bot stdin writable
+	TOKEN_STDOUT = 4, // bot stdout readable
+};
+
+constexpr u64 KIND_BITS   = 3;
+constexpr u64 PLAYER_BITS = 1;
+constexpr u64 SLOT_BITS   = 20;
+constexpr u64 SERIAL_SHIFT = KIND_BITS + PLAYER_BITS + SLOT_BITS;
+
+u64 makeToken(u64 kind, u64 slot, u64 player, u64 serial) {
+	return kind | player << KIND_BITS | slot << (KIND_BITS + PLAYER_BITS) | serial << SERIAL_SHIFT;
+}
+
+struct TokenFields {
+	u64 kind;
+	u64 player;
+	u64 slot;
+	u64 serial;
+};
+
+TokenFields splitToken(u64 token) {
+	return {
+		token & ((1 << KIND_BITS) - 1),
+		(token >> KIND_BITS) & 1,
+		(token >> (KIND_BITS + PLAYER_BITS)) & ((1 << SLOT_BITS) - 1),
+		token >> SERIAL_SHIFT,
+	};
+}
+
+// serials are truncated by the token, so they are compared modulo this
+constexpr u64 SERIAL_MASK = (u64(1) << (64 - SERIAL_SHIFT)) - 1;
+
+// full protocol: more output than this can't be a move
+constexpr u64 MAX_OUTPUT = 1 << 16;
+
+/**
+ * @brief One exec of a game and its move request.
+ */
+struct Bot {
+	pid_t pid = -1;
+	int in_fd  = -1;
+	int out_fd = -1;
+	// new process (or timer) -> new serial, events of old ones are ignored
+	u64 serial = 0;
+	u64 timer_serial = 0;
+
+	std::string pending; // not yet written to stdin
+	std::string output;
+	bool out_eof = false;
+	bool exited  = false;
+	int status   = 0;
+
+	// current request:
+	bool waiting = false;
+	bool sent_delta = false;
+	u64 started_ms = 0;
+	u64 move = referee::WAIT;
+
+	bool alive() const {
+		return pid > 0 and not exited;
+	}
+};
+
+struct GameSlot {
+	bool active = false;
+	Job job;
+	referee::Game game;
+	std::array<Bot, 2> bots;
+	std::array<u64, 2> last_moves = {referee::WAIT, referee::WAIT};
+	std::array<i64, 2> remaining_ms = {0, 0};
+	u64 waiting = 0;
+};
+
+constexpr char WHO[2] = {'R', 'B'};
+
+class Server {
+private:
+	Options options;
+	int epoll_fd;
+	int signal_fd;
+	int jobs_fd;
+	bool jobs_open = true;
+	std::string jobs_buffer;
+	u64 job_lines = 0;
+
+	TimerWheel timers;
+	std::deque<Job> queue;
+	std::vector<GameSlot> games;
+	std::vector<u64> free_slots;
+	u64 active = 0;
+	u64 next_serial = 1;
+	// live bot processes: pid -> (slot, player)
+	std::unordered_map<pid_t, std::pair<u64, u64>> processes;
+
+	void watch(int fd, uint32_t events, u64 token) {
+		epoll_event event = {};
+		event.events = events;
+		event.data.u64 = token;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+			perror("epoll_ctl");
+			std::exit(1);
+		}
+	}
+
+	void warn(const GameSlot& slot, u64 player, const char* message) {
+		std::fprintf(stderr, "Warning: %s: %s %s\n", slot.job.id.c_str(), slot.job.execs[player].c_str(), message);
+	}
+
+	// Jobs
+
+	void readJobs() {
+		char chunk[1 << 16];
+		while (true) {
+			const auto got = ::read(jobs_fd, chunk, sizeof(chunk));
+			if (got > 0) {
+				jobs_buffer.append(chunk, got);
+				continue;
+			}
+			if (got < 0 and errno == EINTR) {
+				continue;
+			}
+			if (got == 0 or (errno != EAGAIN and errno != EWOULDBLOCK)) {
+				jobs_open = false;
+				jobs_buffer += '\n';
+			}
+			break;
+		}
+
+		u64 begin = 0;
+		for (u64 end; (end = jobs_buffer.find('\n', begin)) != std::string::npos; begin = end + 1) {
+			parseJob(std::string_view(jobs_buffer).substr(begin, end - begin));
+		}
+		jobs_buffer.erase(0, begin);
+	}
+
+	void parseJob(std::string_view line) {
+		job_lines++;
+		std::vector<std::string> fields;
+		for (u64 pos = 0; pos < line.size();) {
+			const u64 start = line.find_first_not_of(" \t\r", pos);
+			if (start == std::string_view::npos) {
+				break;
+			}
+			const u64 end = std::min(line.find_first_of(" \t\r", start), line.size());
+			fields.emplace_back(line.substr(start, end - start));
+			pos = end;
+		}
+		if (fields.empty() or fields[0][0] == '#') {
+			return;
+		}
+
+		Job job;
+		job.id = fields[0];
+		job.seed = job_lines;
+		u64* numbers[4] = {&job.seed, &job.n, &job.m, &job.wall_count};
+		bool valid = fields.size() >= 3 and fields.size() <= 7;
+		for (u64 k = 3; valid and k < fields.size(); k++) {
+			char* end;
+			*numbers[k - 3] = std::strtoull(fields[k].c_str(), &end, 10);
+			valid = *end == '\0';
+		}
+		if (not valid) {
+			result(job.id, "ERROR invalid job line");
+			return;
+		}
+		if (job.n < 3 or job.m < 3 or job.n > referee::N or job.m > referee::M) {
+			result(job.id, "ERROR board size not supported");
+			return;
+		}
+		job.execs = {fields[1], fields[2]};
+		queue.push_back(std::move(job));
+	}
+
+	void result(const std::string& id, const std::string& text) {
+		std::fprintf(stdout, "%s %s\n", id.c_str(), text.c_str());
+		std::fflush(stdout);
+	}
+
+	void startJobs() {
+		while (not queue.empty() and not free_slots.empty()) {
+			const u64 index = free_slots.back();
+			free_slots.pop_back();
+			GameSlot& slot = games[index];
+			slot.job = std::move(queue.front());
+			queue.pop_front();
+			slot.active = true;
+			slot.game = referee::Game(slot.job.seed, slot.job.n, slot.job.m, slot.job.wall_count);
+			slot.last_moves = {referee::WAIT, referee::WAIT};
+			slot.remaining_ms = {i64(options.match_budget_ms), i64(options.match_budget_ms)};
+			active++;
+			startRound(index);
+		}
+	}
+
+	// Processes
+
+	bool spawn(u64 index, u64 player) {
+		GameSlot& slot = games[index];
+		Bot& bot = slot.bots[player];
+
+		int in_pipe[2], out_pipe[2];
+		if (pipe2(in_pipe, O_CLOEXEC) != 0) {
+			return false;
+		}
+		if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+			close(in_pipe[0]);
+			close(in_pipe[1]);
+			return false;
+		}
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, in_pipe[0], 0);
+		posix_spawn_file_actions_adddup2(&actions, out_pipe[1], 1);
+
+		// the server blocks SIGCHLD and ignores SIGPIPE, execs get the defaults:
+		posix_spawnattr_t attr;
+		posix_spawnattr_init(&attr);
+		sigset_t mask;
+		sigemptyset(&mask);
+		posix_spawnattr_setsigmask(&attr, &mask);
+		sigaddset(&mask, SIGPIPE);
+		sigaddset(&mask, SIGCHLD);
+		posix_spawnattr_setsigdefault(&attr, &mask);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+		const std::string& exec = slot.job.execs[player];
+		char* argv[] = {const_cast<char*>(exec.c_str()), nullptr};
+		pid_t pid;
+		const int error = posix_spawn(&pid, exec.c_str(), &actions, &attr, argv, environ);
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attr);
+		close(in_pipe[0]);
+		close(out_pipe[1]);
+		if (error != 0) {
+			close(in_pipe[1]);
+			close(out_pipe[0]);
+			return false;
+		}
+
+		fcntl(in_pipe[1], F_SETFL, O_NONBLOCK);
+		fcntl(out_pipe[0], F_SETFL, O_NONBLOCK);
+		bot.pid = pid;
+		bot.in_fd = in_pipe[1];
+		bot.out_fd = out_pipe[0];
+		bot.serial = next_serial++ & SERIAL_MASK;
+		bot.pending.clear();
+		bot.output.clear();
+		bot.out_eof = false;
+		bot.exited = false;
+		bot.status = 0;
+		processes[pid] = {index, player};
+		watch(bot.out_fd, EPOLLIN, makeToken(TOKEN_STDOUT, index, player, bot.serial));
+		return true;
+	}
+
+	void closeInput(Bot& bot) {
+		if (bot.in_fd >= 0) {
+			close(bot.in_fd);
+			bot.in_fd = -1;
+		}
+		bot.pending.clear();
+	}
+
+	/**
+	 * @brief Kills the process (if any) and forgets it, it is reaped on SIGCHLD.
+	 */
+	void dropProcess(Bot& bot) {
+		if (bot.pid > 0) {
+			if (not bot.exited) {
+				kill(bot.pid, SIGKILL);
+			}
+			processes.erase(bot.pid);
+		}
+		closeInput(bot);
+		if (bot.out_fd >= 0) {
+			close(bot.out_fd);
+			bot.out_fd = -1;
+		}
+		bot.pid = -1;
+		bot.serial = next_serial++ & SERIAL_MASK;
+	}
+
+	/**
+	 * @return false if the exec is gone (its stdin is closed)
+	 */
+	bool send(u64 index, u64 player, std::string message) {
+		Bot& bot = games[index].bots[player];
+		if (bot.in_fd < 0) {
+			return false;
+		}
+		const bool idle = bot.pending.empty();
+		bot.pending += message;
+		if (idle) {
+			return flush(index, player);
+		}
+		return true;
+	}
+
+	bool flush(u64 index, u64 player) {
+		Bot& bot = games[index].bots[player];
+		u64 written = 0;
+		while (written < bot.pending.size()) {
+			const auto got = ::write(bot.in_fd, bot.pending.data() + written, bot.pending.size() - written);
+			if (got < 0 and errno == EINTR) {
+				continue;
+			}
+			if (got < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) {
+				break;
+			}
+			if (got < 0) {
+				closeInput(bot);
+				return false;
+			}
+			written += got;
+		}
+		bot.pending.erase(0, written);
+
+		epoll_event event = {};
+		event.data.u64 = makeToken(TOKEN_STDIN, index, player, bot.serial);
+		event.events = EPOLLOUT;
+		if (not bot.pending.empty()) {
+			if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, bot.in_fd, &event) != 0) {
+				watch(bot.in_fd, EPOLLOUT, event.data.u64);
+			}
+		} else {
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, bot.in_fd, nullptr);
+			if (options.protocol == Protocol::FULL) {
+				// whole state sent, like subprocess.check_output(input = ...):
+				closeInput(bot);
+			}
+		}
+		return true;
+	}
+
+	// Moves
+
+	std::pair<u64, u64> clock(const GameSlot& slot, u64 player) const {
+		if (options.match_budget_ms == 0) {
+			return {options.timeout_ms, 0};
+		}
+		const u64 remaining = std::max<i64>(slot.remaining_ms[player], 0);
+		return {std::min(options.timeout_ms, remaining), remaining};
+	}
+
+	std::string fullState(const GameSlot& slot, u64 player) const {
+		auto [time_limit, remaining] = clock(slot, player);
+		if (options.state_format == StateFormat::BINARY) {
+			return slot.game.binaryState(WHO[player], time_limit, remaining);
+		}
+		return slot.game.textState(WHO[player], time_limit, remaining);
+	}
+
+	std::string deltaLine(const GameSlot& slot, u64 player) const {
+		auto [time_limit, remaining] = clock(slot, player);
+		return std::to_string(slot.game.round) + " " + std::to_string(slot.last_moves[1 - player]) + " "
+			+ std::to_string(slot.game.checksum()) + " " + std::to_string(time_limit) + " "
+			+ std::to_string(remaining) + "\n";
+	}
+
+	void armTimer(u64 index, u64 player) {
+		Bot& bot = games[index].bots[player];
+		bot.timer_serial = (bot.timer_serial + 1) & SERIAL_MASK;
+		timers.add(nowMs() + clock(games[index], player).first, makeToken(0, index, player, bot.timer_serial));
+	}
+
+	/**
+	 * @brief Starts a fresh exec with the whole state.
+	 */
+	void restart(u64 index, u64 player) {
+		GameSlot& slot = games[index];
+		Bot& bot = slot.bots[player];
+		dropProcess(bot);
+		bot.sent_delta = false;
+		if (not spawn(index, player)) {
+			warn(slot, player, "can't be started -- surrendering.");
+			finishMove(index, player, referee::SURRENDER);
+			return;
+		}
+		send(index, player, fullState(slot, player));
+		armTimer(index, player);
+	}
+
+	void requestMove(u64 index, u64 player) {
+		GameSlot& slot = games[index];
+		Bot& bot = slot.bots[player];
+		bot.waiting = true;
+		bot.started_ms = nowMs();
+
+		if (options.match_budget_ms != 0 and slot.remaining_ms[player] <= 0) {
+			warn(slot, player, "used whole match budget -- waiting.");
+			finishMove(index, player, referee::WAIT);
+			return;
+		}
+
+		if (options.protocol == Protocol::DELTA and bot.alive() and slot.game.round > 0
+				and send(index, player, deltaLine(slot, player))) {
+			bot.sent_delta = true;
+			armTimer(index, player);
+			// a line may be already buffered:
+			processOutput(index, player);
+			return;
+		}
+		restart(index, player);
+	}
+
+	void startRound(u64 index) {
+		GameSlot& slot = games[index];
+		slot.waiting = 2;
+		for (u64 player = 0; player < 2; player++) {
+			requestMove(index, player);
+		}
+	}
+
+	/**
+	 * @brief Runner.parseOutput: int() of the stripped output, in [0, 9].
+	 */
+	u64 parseMove(GameSlot& slot, u64 player, std::string_view out) {
+		const u64 begin = out.find_first_not_of(" \t\r\n");
+		out = begin == std::string_view::npos ? std::string_view() : out.substr(begin, out.find_last_not_of(" \t\r\n") - begin + 1);
+		bool negative = false;
+		if (not out.empty() and (out[0] == '+' or out[0] == '-')) {
+			negative = out[0] == '-';
+			out.remove_prefix(1);
+		}
+		u64 value = 0;
+		bool valid = not out.empty();
+		for (char c: out) {
+			valid = valid and c >= '0' and c <= '9';
+			value = std::min<u64>(value * 10 + (c - '0'), 10);
+		}
+		if (valid and value <= 9 and (not negative or value == 0)) {
+			return value;
+		}
+		warn(slot, player, "returned invalid value -- surrendering.");
+		return referee::SURRENDER;
+	}
+
+	void finishMove(u64 index, u64 player, u64 move) {
+		GameSlot& slot = games[index];
+		Bot& bot = slot.bots[player];
+		if (not bot.waiting) {
+			return;
+		}
+		bot.waiting = false;
+		bot.move = move;
+		bot.timer_serial = (bot.timer_serial + 1) & SERIAL_MASK;
+		if (options.match_budget_ms != 0) {
+			slot.remaining_ms[player] -= nowMs() - bot.started_ms;
+		}
+		if (--slot.waiting == 0) {
+			endRound(index);
+		}
+	}
+
+	void endRound(u64 index) {
+		GameSlot& slot = games[index];
+		const u64 red_move = slot.bots[0].move;
+		const u64 blue_move = slot.bots[1].move;
+		const uint8_t hits = slot.game.applyMove(red_move, blue_move);
+		slot.last_moves = {red_move, blue_move};
+
+		if (hits == (referee::RED_HIT | referee::BLUE_HIT)) {
+			endGame(index, "TIE");
+		} else if (hits == referee::BLUE_HIT) {
+			endGame(index, "RED");
+		} else if (hits == referee::RED_HIT) {
+			endGame(index, "BLUE");
+		} else if (slot.game.round >= options.round_count) {
+			endGame(index, "TIE");
+		} else {
+			startRound(index);
+		}
+	}
+
+	void endGame(u64 index, const char* winner) {
+		GameSlot& slot = games[index];
+		for (Bot& bot: slot.bots) {
+			dropProcess(bot);
+		}
+		result(slot.job.id, std::string(winner) + " " + std::to_string(slot.game.round));
+		slot.active = false;
+		active--;
+		free_slots.push_back(index);
+		startJobs();
+	}
+
+	/**
+	 * @brief Delta protocol: handles buffered lines and EOF (as BotProcess.readLine does).
+	 * Full protocol: the answer is the whole output, once the exec exited.
+	 */
+	void processOutput(u64 index, u64 player) {
+		GameSlot& slot = games[index];
+		Bot& bot = slot.bots[player];
+		if (not bot.waiting) {
+			return;
+		}
+
+		if (options.protocol == Protocol::FULL) {
+			if (not bot.out_eof or not bot.exited) {
+				return;
+			}
+			const bool failed = not WIFEXITED(bot.status) or WEXITSTATUS(bot.status) != 0;
+			const std::string output = std::move(bot.output);
+			dropProcess(bot);
+			if (failed) {
+				warn(slot, player, "returned non zero code -- surrendering.");
+				finishMove(index, player, referee::SURRENDER);
+			} else if (output.size() > MAX_OUTPUT) {
+				warn(slot, player, "returned invalid value -- surrendering.");
+				finishMove(index, player, referee::SURRENDER);
+			} else {
+				finishMove(index, player, parseMove(slot, player, output));
+			}
+			return;
+		}
+
+		while (bot.waiting) {
+			const u64 end = bot.output.find('\n');
+			if (end == std::string::npos and not bot.out_eof) {
+				return;
+			}
+			std::string line = bot.output.substr(0, end);
+			bot.output.erase(0, end == std::string::npos ? std::string::npos : end + 1);
+			line.erase(0, line.find_first_not_of(" \t\r\n"));
+			line.erase(line.find_last_not_of(" \t\r\n") + 1);
+
+			if (end == std::string::npos and line.empty()) {
+				// EOF:
+				if (bot.sent_delta) {
+					// exec does not keep running -- start it again with whole state:
+					restart(index, player);
+					continue;
+				}
+				if (not bot.exited) {
+					// wait for the status, to tell a crash from an empty answer
+					return;
+				}
+				const bool failed = not WIFEXITED(bot.status) or WEXITSTATUS(bot.status) != 0;
+				warn(slot, player, failed ? "returned non zero code -- surrendering." : "returned invalid value -- surrendering.");
+				finishMove(index, player, referee::SURRENDER);
+				return;
+			}
+			if (line == "resync") {
+				send(index, player, fullState(slot, player));
+				armTimer(index, player);
+				bot.sent_delta = false;
+				continue;
+			}
+			finishMove(index, player, parseMove(slot, player, line));
+		}
+	}
+
+	// Events
+
+	void onStdout(u64 index, u64 player) {
+		Bot& bot = games[index].bots[player];
+		char chunk[1 << 12];
+		while (bot.out_fd >= 0) {
+			const auto got = ::read(bot.out_fd, chunk, sizeof(chunk));
+			if (got > 0) {
+				if (bot.output.size() <= MAX_OUTPUT) {
+					bot.output.append(chunk, got);
+				}
+				continue;
+			}
+			if (got < 0 and errno == EINTR) {
+				continue;
+			}
+			if (got < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) {
+				break;
+			}
+			bot.out_eof = true;
+			close(bot.out_fd);
+			bot.out_fd = -1;
+		}
+		processOutput(index, player);
+	}
+
+	void onTimer(u64 token) {
+		const TokenFields fields = splitToken(token);
+		GameSlot& slot = games[fields.slot];
+		Bot& bot = slot.bots[fields.player];
+		if (not slot.active or not bot.waiting or bot.timer_serial != fields.serial) {
+			return;
+		}
+		// late answer would break the protocol, so the exec is restarted next round
+		warn(slot, fields.player, "hit timeout");
+		dropProcess(bot);
+		finishMove(fields.slot, fields.player, referee::WAIT);
+	}
+
+	void onSignal() {
+		signalfd_siginfo info;
+		while (::read(signal_fd, &info, sizeof(info)) == sizeof(info)) {}
+
+		int status;
+		pid_t pid;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			const auto it = processes.find(pid);
+			if (it == processes.end()) {
+				// killed and forgotten
+				continue;
+			}
+			auto [index, player] = it->second;
+			Bot& bot = games[index].bots[player];
+			bot.exited = true;
+			bot.status = status;
+			processes.erase(it);
+			if (bot.out_fd >= 0) {
+				// the rest of the output first:
+				onStdout(index, player);
+			} else {
+				processOutput(index, player);
+			}
+		}
+	}
+
+	void dispatch(u64 token) {
+		const TokenFields fields = splitToken(token);
+		if (fields.kind == TOKEN_JOBS) {
+			readJobs();
+			startJobs();
+			return;
+		}
+		if (fields.kind == TOKEN_TIMER) {
+			timers.advance([&](u64 timer) { onTimer(timer); });
+			return;
+		}
+		if (fields.kind == TOKEN_SIGNAL) {
+			onSignal();
+			return;
+		}
+
+		GameSlot& slot = games[fields.slot];
+		Bot& bot = slot.bots[fields.player];
+		if (not slot.active or bot.serial != fields.serial) {
+			// an event of an old process
+			return;
+		}
+		if (fields.kind == TOKEN_STDIN) {
+			flush(fields.slot, fields.player);
+		} else {
+			onStdout(fields.slot, fields.player);
+		}
+	}
+
+public:
+	explicit Server(const Options& options)
+		: options(options), games(options.games) {
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &mask, nullptr);
+		signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		signal(SIGPIPE, SIG_IGN);
+
+		watch(signal_fd, EPOLLIN, TOKEN_SIGNAL);
+		watch(timers.descriptor(), EPOLLIN, TOKEN_TIMER);
+
+		jobs_fd = options.jobs_path == nullptr ? 0 : open(options.jobs_path, O_RDONLY | O_CLOEXEC);
+		if (jobs_fd < 0) {
+			perror(options.jobs_path);
+			std::exit(1);
+		}
+		fcntl(jobs_fd, F_SETFL, fcntl(jobs_fd, F_GETFL) | O_NONBLOCK);
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u64 = TOKEN_JOBS;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, jobs_fd, &event) != 0) {
+			// regular file -- always readable, so read it at once:
+			while (jobs_open) {
+				readJobs();
+			}
+		}
+
+		for (u64 index = options.games; index-- > 0;) {
+			free_slots.push_back(index);
+		}
+	}
+
+	void run() {
+		startJobs();
+		std::array<epoll_event, 256> events;
+		while (jobs_open or active > 0 or not queue.empty()) {
+			const int count = epoll_wait(epoll_fd, events.data(), events.size(), -1);
+			if (count < 0 and errno != EINTR) {
+				perror("epoll_wait");
+				std::exit(1);
+			}
+			for (int k = 0; k < count; k++) {
+				dispatch(events[k].data.u64);
+			}
+		}
+	}
+};
+
+bool parseOptions(int argc, char** argv, Options& options) {
+	for (int k = 1; k < argc; k++) {
+		const std::string_view arg = argv[k];
+		const char* value = k + 1 < argc ? argv[k + 1] : nullptr;
+		auto number = [&](u64& out) {
+			if (value == nullptr) {
+				return false;
+			}
+			char* end;
+			out = std::strtoull(value, &end, 10);
+			k++;
+			return *end == '\0';
+		};
+
+		if (arg == "-g" or arg == "--games") {
+			if (not number(options.games) or options.games == 0 or options.games >= (u64(1) << SLOT_BITS)) {
+				return false;
+			}
+		} else if (arg == "-t" or arg == "--timeout") {
+			if (not number(options.timeout_ms)) {
+				return false;
+			}
+		} else if (arg == "--match-budget") {
+			if (not number(options.match_budget_ms)) {
+				return false;
+			}
+		} else if (arg == "--round-count") {
+			if (not number(options.round_count)) {
+				return false;
+			}
+		} else if (arg == "--protocol" and value != nullptr and (value == std::string_view("full") or value == std::string_view("delta"))) {
+			options.protocol = value == std::string_view("full") ? Protocol::FULL : Protocol::DELTA;
+			k++;
+		} else if (arg == "--state-format" and value != nullptr and (value == std::string_view("text") or value == std::string_view("binary"))) {
+			options.state_format = value == std::string_view("text") ? StateFormat::TEXT : StateFormat::BINARY;
+			k++;
+		} else if (arg[0] != '-' and options.jobs_path == nullptr) {
+			options.jobs_path = argv[k];
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (not parseOptions(argc, argv, options)) {
+		std::fprintf(stderr, "Usage: %s [-g games] [-t timeout_ms] [--match-budget ms] [--round-count n] "
+			"[--protocol full|delta] [--state-format text|binary] [jobs_file]\n", argv[0]);
+		return 2;
+	}
+
+	// 2 pipes per exec, 4 per game:
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 and limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	Server server(options);
+	server.run();
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "../solutions/common/bitboard.hpp"
+#include "../solutions/common/game.hpp"
+#include "../solutions/common/lanes.hpp"
+#include "../solutions/common/protocol.hpp"
+
+namespace referee {
+
+/**
+ * Native referee core: the rules of GameLogic (python_impl/internal/logic.py)
+ * on bitboards, and the states sent to execs (python_impl/internal/runner.py).
+ * Boards are at most common::MAX_N x common::MAX_M.
+ */
+
+using common::u64;
+using common::i64;
+
+constexpr u64 N = common::MAX_N;
+constexpr u64 M = common::MAX_M;
+using Board = common::Bitboard<N, M>;
+using Planes = std::array<Board, 4>;
+
+constexpr u64 SHIFT[4] = {u64(-i64(M)), M, u64(-1), 1};
+
+// hits, as in GameLogic.applyMove output:
+constexpr uint8_t RED_HIT  = 1;
+constexpr uint8_t BLUE_HIT = 2;
+
+// MoveProfile values:
+constexpr u64 WAIT = 8;
+constexpr u64 SURRENDER = 9;
+
+/**
+ * @brief Map like GameLogic.__init__ (symmetric random walls, border walls,
+ * free start cells), but from our own generator, so seeds don't match the Python referee.
+ */
+inline Board generateWalls(u64 seed, u64 n, u64 m, u64 wall_count) {
+	common::LaneRng rng(seed);
+	Board walls;
+	for (u64 k = 0; k < wall_count / 2; k++) {
+		const u64 x = rng() % n;
+		const u64 y = rng() % m;
+		walls.set(Board::index(x, y));
+		walls.set(Board::index(n - x - 1, m - y - 1));
+	}
+	walls.reset(Board::index(1, 1));
+	walls.reset(Board::index(n - 2, m - 2));
+	for (u64 x = 0; x < n; x++) {
+		walls.set(Board::index(x, 0));
+		walls.set(Board::index(x, m - 1));
+	}
+	for (u64 y = 0; y < m; y++) {
+		walls.set(Board::index(0, y));
+		walls.set(Board::index(n - 1, y));
+	}
+	return walls;
+}
+
+inline Planes blockedPlanes(const Board& walls) {
+	Planes res;
+	for (u64 dir = 0; dir < 4; dir++) {
+		res[dir] = walls.shifted(-common::Arena<N, M>::SHIFT[dir]);
+	}
+	return res;
+}
+
+/**
+ * @brief GameLogic.applyMove: players act (shots start in the player cell,
+ * moves into walls stay, players moving into one cell both stay), then bullets move.
+ * @return RED_HIT / BLUE_HIT mask, surrender (or an invalid move) counts as a hit
+ */
+inline uint8_t applyMove(const Planes& blocked, Planes& bullets, u64& red, u64& blue, u64 red_move, u64 blue_move) {
+	uint8_t hits = 0;
+	if (red_move >= SURRENDER) {
+		hits |= RED_HIT;
+	}
+	if (blue_move >= SURRENDER) {
+		hits |= BLUE_HIT;
+	}
+	if (hits != 0) {
+		return hits;
+	}
+
+	auto act = [&](u64 cell, u64 move) -> u64 {
+		if (move < 4) {
+			return blocked[move].test(cell) ? cell : cell + SHIFT[move];
+		}
+		if (move < 8) {
+			bullets[move - 4].set(cell);
+		}
+		return cell;
+	};
+	const u64 new_red  = act(red, red_move);
+	const u64 new_blue = act(blue, blue_move);
+	if (new_red != new_blue) {
+		red  = new_red;
+		blue = new_blue;
+	}
+
+	bullets = {
+		common::bulletStep<-i64(M)>(bullets[0], blocked[0], bullets[1], blocked[1]),
+		common::bulletStep<i64(M)>(bullets[1], blocked[1], bullets[0], blocked[0]),
+		common::bulletStep<-1>(bullets[2], blocked[2], bullets[3], blocked[3]),
+		common::bulletStep<1>(bullets[3], blocked[3], bullets[2], blocked[2]),
+	};
+
+	const Board occupied = bullets[0] | bullets[1] | bullets[2] | bullets[3];
+	hits |= occupied.test(red) ? RED_HIT : 0;
+	hits |= occupied.test(blue) ? BLUE_HIT : 0;
+	return hits;
+}
+
+/**
+ * @brief One game with its state in Game (runner.py) formats.
+ */
+struct Game {
+	u64 n = 0;
+	u64 m = 0;
+	u64 round = 0;
+	Board walls;
+	Planes blocked;
+	Planes bullets;
+	u64 red  = 0;
+	u64 blue = 0;
+
+	Game() = default;
+
+	Game(u64 seed, u64 n, u64 m, u64 wall_count)
+		: n(n), m(m), walls(generateWalls(seed, n, m, wall_count)), blocked(blockedPlanes(walls)),
+		  red(Board::index(1, 1)), blue(Board::index(n - 2, m - 2)) {}
+
+	uint8_t applyMove(u64 red_move, u64 blue_move) {
+		const uint8_t hits = referee::applyMove(blocked, bullets, red, blue, red_move, blue_move);
+		round++;
+		return hits;
+	}
+
+	// cell in the referee layout (x * m + y)
+	u64 refereeCell(u64 cell) const {
+		return cell / M * m + cell % M;
+	}
+
+	/**
+	 * @brief GameLogic.stateChecksum
+	 */
+	u64 checksum() const {
+		u64 res = 0;
+		for (u64 dir = 0; dir < 4; dir++) {
+			bullets[dir].forEach([&](u64 cell) { res += common::bulletChecksum(refereeCell(cell), dir); });
+		}
+		return res + common::redChecksum(refereeCell(red)) + common::blueChecksum(refereeCell(blue));
+	}
+
+	/**
+	 * @brief "text" state format (Game.stateForUser).
+	 */
+	std::string textState(char who, u64 time_limit_ms, u64 remaining_ms) const {
+		static constexpr char BULLET_CHARS[4] = {'^', 'v', '<', '>'};
+		std::string res = std::to_string(n) + " " + std::to_string(m) + "\n";
+		res.reserve(res.size() + n * (4 * m + 1) + 32);
+		for (u64 x = 0; x < n; x++) {
+			for (u64 y = 0; y < m; y++) {
+				const u64 cell = Board::index(x, y);
+				char tile[4] = {walls.test(cell) ? '#' : ' ', ' ', ' ', ' '};
+				if (cell == red) {
+					tile[0] = 'R';
+				}
+				if (cell == blue) {
+					tile[0] = 'B';
+				}
+				// bullets are drawn after players (like BoardRenderer):
+				for (u64 dir = 0; dir < 4; dir++) {
+					if (bullets[dir].test(cell)) {
+						tile[dir] = BULLET_CHARS[dir];
+					}
+				}
+				res.append(tile, 4);
+			}
+			res += '\n';
+		}
+		res += std::to_string(round) + "\n" + who + "\n";
+		res += std::to_string(time_limit_ms) + " " + std::to_string(remaining_ms) + "\n";
+		return res;
+	}
+
+	/**
+	 * @brief "binary" state format: header and GameLogic.packPlanes.
+	 */
+	std::string binaryState(char who, u64 time_limit_ms, u64 remaining_ms) const {
+		const u64 words = (n * m + 63) / 64;
+		std::string res(common::BINARY_HEADER_SIZE + 7 * 8 * words, '\0');
+		char* out = res.data();
+
+		auto put = [&](u64 offset, u64 value, u64 bytes) {
+			// little endian, as the referee packs it:
+			for (u64 k = 0; k < bytes; k++) {
+				out[offset + k] = char((value >> (8 * k)) & 0xff);
+			}
+		};
+		std::memcpy(out, common::BINARY_MAGIC, 4);
+		put(4, n, 2);
+		put(6, m, 2);
+		put(8, round, 4);
+		out[12] = who;
+		put(16, time_limit_ms, 4);
+		put(20, remaining_ms, 4);
+
+		char* planes = out + common::BINARY_HEADER_SIZE;
+		auto setBit = [&](u64 plane, u64 cell) {
+			const u64 bit = refereeCell(cell);
+			planes[plane * 8 * words + bit / 8] |= char(1 << (bit % 8));
+		};
+		walls.forEach([&](u64 cell) { setBit(0, cell); });
+		for (u64 dir = 0; dir < 4; dir++) {
+			bullets[dir].forEach([&](u64 cell) { setBit(1 + dir, cell); });
+		}
+		setBit(5, red);
+		setBit(6, blue);
+		return res;
+	}
+};
+
+}
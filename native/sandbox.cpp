@@ -0,0 +1,484 @@
+// Sandbox launcher: runs one exec in a jail that is set up once per game.
+//
+// Usage: sandbox [--memory MB] [--no-namespaces] [--persistent] EXEC
+//
+// Jail: new user, mount, pid, network, IPC and UTS namespaces; the root is an empty
+// read-only tmpfs with the exec bound at /exec (so execs have to be static, as tournament
+// builds are). Every run of the exec gets rlimits (address space, CPU, no files, no core
+// dumps) and a seccomp filter that denies new processes, sockets, ptrace and
+// namespace/mount/module/kernel calls. Threads are allowed.
+//
+// Default mode ("full" protocol): the launcher stays alive for the game and runs the exec
+// once per request. Requests and responses on stdin/stdout, little endian:
+//   request:  u32 input length, u32 CPU time limit, u32 wall time limit (ms, 0 = none), input
+//   response: u32 status (RUN_*), i32 exit code or signal, u32 wall us, u32 cpu us,
+//             u32 output length, output
+// CPU time (of all threads) is watched while the exec runs, so execs burning several cores
+// are stopped at the CPU limit; the wall limit is meant to be looser (loaded hosts).
+// --persistent ("delta" protocol): the exec itself is started in the jail once,
+// with stdin/stdout of the launcher.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+using u64 = uint64_t;
+
+enum RunStatus : uint32_t {
+	RUN_OK         = 0,
+	RUN_CPU_LIMIT  = 1,
+	RUN_ERROR      = 2, // non zero exit code or killed by a signal
+	RUN_SPAWN      = 3, // exec could not be started
+	RUN_WALL_LIMIT = 4,
+};
+
+constexpr const char* JAIL_EXEC = "/exec";
+// the new root is mounted over this directory, only in our mount namespace:
+constexpr const char* JAIL_ROOT = "/tmp";
+constexpr u64 MAX_OUTPUT = 1 << 16;
+// how often CPU time of a running exec is checked:
+constexpr u64 CPU_POLL_US = 2000;
+
+struct Options {
+	u64 memory_mb = 256;
+	bool namespaces = true;
+	bool persistent = false;
+	const char* exec = nullptr;
+};
+
+[[noreturn]] void fail(const char* what) {
+	std::fprintf(stderr, "sandbox: %s: %s\n", what, std::strerror(errno));
+	std::exit(125);
+}
+
+void writeFile(const char* path, std::string_view content) {
+	const int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0 or write(fd, content.data(), content.size()) != ssize_t(content.size())) {
+		fail(path);
+	}
+	close(fd);
+}
+
+/**
+ * @brief Namespaces and the jail root, done once by the launcher.
+ * The pid namespace applies to children, the first one is its init.
+ */
+void enterJail(const Options& options) {
+	const uid_t uid = getuid();
+	const gid_t gid = getgid();
+	if (unshare(CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWPID | CLONE_NEWNET | CLONE_NEWIPC | CLONE_NEWUTS) != 0) {
+		fail("unshare");
+	}
+	writeFile("/proc/self/setgroups", "deny");
+	writeFile("/proc/self/uid_map", "0 " + std::to_string(uid) + " 1");
+	writeFile("/proc/self/gid_map", "0 " + std::to_string(gid) + " 1");
+
+	if (mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0) {
+		fail("mount /");
+	}
+	// opened in the new mount namespace (to be bound from there), before /tmp (where it may live) is hidden:
+	const int exec_fd = open(options.exec, O_PATH | O_CLOEXEC);
+	if (exec_fd < 0) {
+		fail(options.exec);
+	}
+	if (mount("jail", JAIL_ROOT, "tmpfs", MS_NOSUID | MS_NODEV, "size=64k,mode=0755") != 0) {
+		fail("mount tmpfs");
+	}
+	const std::string target = std::string(JAIL_ROOT) + JAIL_EXEC;
+	const int file = open(target.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0755);
+	if (file < 0) {
+		fail("jail exec");
+	}
+	close(file);
+	const std::string source = "/proc/self/fd/" + std::to_string(exec_fd);
+	if (mount(source.c_str(), target.c_str(), nullptr, MS_BIND, nullptr) != 0
+			or mount(nullptr, target.c_str(), nullptr, MS_REMOUNT | MS_BIND | MS_RDONLY | MS_NOSUID | MS_NODEV, nullptr) != 0
+			or mount(nullptr, JAIL_ROOT, nullptr, MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV, nullptr) != 0) {
+		fail("bind exec");
+	}
+	if (chdir(JAIL_ROOT) != 0 or chroot(".") != 0 or chdir("/") != 0) {
+		fail("chroot");
+	}
+	close(exec_fd);
+}
+
+#if defined(__x86_64__)
+constexpr uint32_t FILTER_ARCH = AUDIT_ARCH_X86_64;
+#elif defined(__aarch64__)
+constexpr uint32_t FILTER_ARCH = AUDIT_ARCH_AARCH64;
+#else
+#error "seccomp filter: unsupported architecture"
+#endif
+
+/**
+ * @brief Deny list: calls an exec never needs, and all ways out of the jail.
+ * clone is allowed only for threads, clone3 reports ENOSYS (so libc falls back to clone).
+ */
+void installSeccomp() {
+	static constexpr long DENIED[] = {
+#ifdef SYS_fork
+		SYS_fork,
+#endif
+#ifdef SYS_vfork
+		SYS_vfork,
+#endif
+		SYS_socket, SYS_socketpair, SYS_connect, SYS_bind, SYS_listen, SYS_accept, SYS_accept4,
+		SYS_ptrace, SYS_process_vm_readv, SYS_process_vm_writev,
+		SYS_mount, SYS_umount2, SYS_pivot_root, SYS_chroot, SYS_unshare, SYS_setns,
+		SYS_init_module, SYS_finit_module, SYS_delete_module, SYS_kexec_load, SYS_reboot,
+		SYS_swapon, SYS_swapoff, SYS_bpf, SYS_perf_event_open, SYS_userfaultfd,
+		SYS_keyctl, SYS_add_key, SYS_request_key, SYS_personality,
+	};
+
+	std::vector<sock_filter> filter = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, FILTER_ARCH, 1, 0),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+	};
+#if defined(__x86_64__)
+	// x32 numbers would bypass the list:
+	filter.push_back(BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 0x40000000, 0, 1));
+	filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+#endif
+	for (long call: DENIED) {
+		filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, uint32_t(call), 0, 1));
+		filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM));
+	}
+	filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone3, 0, 1));
+	filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS));
+	// clone: flags are the first argument (low word)
+	filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone, 0, 3));
+	filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, args[0])));
+	filter.push_back(BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, CLONE_THREAD, 1, 0));
+	filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM));
+	filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+
+	sock_fprog program = {uint16_t(filter.size()), filter.data()};
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 or prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) != 0) {
+		fail("seccomp");
+	}
+}
+
+void setLimit(int resource, rlim_t soft, rlim_t hard) {
+	rlimit limit = {soft, hard};
+	if (setrlimit(resource, &limit) != 0) {
+		fail("setrlimit");
+	}
+}
+
+/**
+ * @brief In the child: limits, filter and exec (no return).
+ */
+[[noreturn]] void execJailed(const Options& options, u64 cpu_limit_ms) {
+	const char* path = options.namespaces ? JAIL_EXEC : options.exec;
+	setLimit(RLIMIT_AS, options.memory_mb << 20, options.memory_mb << 20);
+	setLimit(RLIMIT_FSIZE, 0, 0);
+	setLimit(RLIMIT_CORE, 0, 0);
+	setLimit(RLIMIT_NOFILE, 64, 64);
+	if (cpu_limit_ms != 0) {
+		// backstop only, the launcher watches CPU time precisely:
+		const rlim_t seconds = (cpu_limit_ms + 999) / 1000;
+		setLimit(RLIMIT_CPU, seconds, seconds + 1);
+	}
+	installSeccomp();
+
+	char* argv[] = {const_cast<char*>(path), nullptr};
+	char* envp[] = {nullptr};
+	execve(path, argv, envp);
+	_exit(127);
+}
+
+bool readAll(int fd, void* data, u64 size) {
+	char* out = static_cast<char*>(data);
+	while (size > 0) {
+		const ssize_t got = read(fd, out, size);
+		if (got < 0 and errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			return false;
+		}
+		out += got;
+		size -= got;
+	}
+	return true;
+}
+
+bool writeAll(int fd, const void* data, u64 size) {
+	const char* in = static_cast<const char*>(data);
+	while (size > 0) {
+		const ssize_t got = write(fd, in, size);
+		if (got < 0 and errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			return false;
+		}
+		in += got;
+		size -= got;
+	}
+	return true;
+}
+
+struct Response {
+	uint32_t status = RUN_OK;
+	int32_t code = 0;
+	uint32_t wall_us = 0;
+	uint32_t cpu_us = 0;
+	uint32_t length = 0;
+};
+
+u64 nowUs() {
+	using namespace std::chrono;
+	return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/** @brief CPU time of a running process (all threads), 0 if it is gone. */
+u64 cpuUs(clockid_t clock) {
+	timespec time;
+	if (clock_gettime(clock, &time) != 0) {
+		return 0;
+	}
+	return u64(time.tv_sec) * 1'000'000 + time.tv_nsec / 1000;
+}
+
+/**
+ * @brief One run of the exec: input to its stdin, its stdout back, within the time limits.
+ */
+Response runOnce(const Options& options, const std::string& input, u64 cpu_limit_ms, u64 wall_limit_ms, std::string& output) {
+	Response response;
+	output.clear();
+
+	int in_pipe[2], out_pipe[2];
+	if (pipe2(in_pipe, O_CLOEXEC) != 0 or pipe2(out_pipe, O_CLOEXEC) != 0) {
+		response.status = RUN_SPAWN;
+		return response;
+	}
+	const u64 started = nowUs();
+	const pid_t pid = fork();
+	if (pid == 0) {
+		dup2(in_pipe[0], 0);
+		dup2(out_pipe[1], 1);
+		execJailed(options, cpu_limit_ms);
+	}
+	close(in_pipe[0]);
+	close(out_pipe[1]);
+	if (pid < 0) {
+		close(in_pipe[1]);
+		close(out_pipe[0]);
+		response.status = RUN_SPAWN;
+		return response;
+	}
+
+	fcntl(in_pipe[1], F_SETFL, O_NONBLOCK);
+	int in_fd = in_pipe[1];
+	int out_fd = out_pipe[0];
+	u64 written = 0;
+	if (input.empty()) {
+		close(in_fd);
+		in_fd = -1;
+	}
+	clockid_t cpu_clock;
+	if (cpu_limit_ms != 0 and clock_getcpuclockid(pid, &cpu_clock) != 0) {
+		cpu_limit_ms = 0;
+	}
+	const u64 deadline = wall_limit_ms == 0 ? UINT64_MAX : started + 1000 * wall_limit_ms;
+	// RUN_OK while within both limits:
+	uint32_t limit = RUN_OK;
+	const auto checkLimits = [&](u64 now) {
+		if (now >= deadline) {
+			limit = RUN_WALL_LIMIT;
+		} else if (cpu_limit_ms != 0 and cpuUs(cpu_clock) > 1000 * cpu_limit_ms) {
+			limit = RUN_CPU_LIMIT;
+		}
+		return limit == RUN_OK;
+	};
+
+	while (out_fd >= 0 and checkLimits(nowUs())) {
+		pollfd fds[2];
+		int count = 0;
+		fds[count++] = {out_fd, POLLIN, 0};
+		if (in_fd >= 0) {
+			fds[count++] = {in_fd, POLLOUT, 0};
+		}
+		u64 wait_us = deadline == UINT64_MAX ? UINT64_MAX : deadline - nowUs();
+		if (cpu_limit_ms != 0) {
+			wait_us = std::min(wait_us, CPU_POLL_US);
+		}
+		const int wait_ms = wait_us == UINT64_MAX ? -1 : int((wait_us + 999) / 1000);
+		if (poll(fds, count, wait_ms) < 0 and errno != EINTR) {
+			break;
+		}
+		if (in_fd >= 0 and fds[1].revents != 0) {
+			const ssize_t got = write(in_fd, input.data() + written, input.size() - written);
+			if (got > 0) {
+				written += got;
+			}
+			if (got < 0 and errno != EAGAIN and errno != EINTR) {
+				written = input.size();
+			}
+			if (written == input.size()) {
+				close(in_fd);
+				in_fd = -1;
+			}
+		}
+		if (fds[0].revents != 0) {
+			char chunk[1 << 12];
+			const ssize_t got = read(out_fd, chunk, sizeof(chunk));
+			if (got > 0) {
+				if (output.size() < MAX_OUTPUT) {
+					output.append(chunk, std::min<u64>(got, MAX_OUTPUT - output.size()));
+				}
+			} else if (got == 0 or errno != EINTR) {
+				close(out_fd);
+				out_fd = -1;
+			}
+		}
+	}
+	if (in_fd >= 0) {
+		close(in_fd);
+	}
+	if (out_fd >= 0) {
+		close(out_fd);
+	}
+
+	int status = 0;
+	rusage usage = {};
+	// stdout may be closed before the exit, which has to come within the limits too:
+	while (limit == RUN_OK and wait4(pid, &status, WNOHANG, &usage) == 0) {
+		if (checkLimits(nowUs())) {
+			usleep(100);
+		}
+	}
+	if (limit != RUN_OK) {
+		kill(pid, SIGKILL);
+		wait4(pid, &status, 0, &usage);
+	}
+
+	response.wall_us = uint32_t(std::min<u64>(nowUs() - started, UINT32_MAX));
+	const u64 cpu_us = u64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1'000'000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+	response.cpu_us = uint32_t(std::min<u64>(cpu_us, UINT32_MAX));
+
+	if (limit == RUN_OK and ((cpu_limit_ms != 0 and cpu_us > 1000 * cpu_limit_ms)
+			or (WIFSIGNALED(status) and WTERMSIG(status) == SIGXCPU))) {
+		limit = RUN_CPU_LIMIT;
+	}
+	if (limit != RUN_OK) {
+		response.status = limit;
+	} else if (WIFEXITED(status) and WEXITSTATUS(status) == 127) {
+		response.status = RUN_SPAWN;
+		response.code = 127;
+	} else if (not WIFEXITED(status) or WEXITSTATUS(status) != 0) {
+		response.status = RUN_ERROR;
+		response.code = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+	}
+	response.length = response.status == RUN_OK ? output.size() : 0;
+	return response;
+}
+
+/**
+ * @brief Request loop of the default mode (runs as init of the jail's pid namespace).
+ */
+int serve(const Options& options) {
+	std::string input;
+	std::string output;
+	while (true) {
+		uint32_t header[3];
+		if (not readAll(0, header, sizeof(header))) {
+			return 0;
+		}
+		input.resize(header[0]);
+		if (not readAll(0, input.data(), input.size())) {
+			return 0;
+		}
+		const Response response = runOnce(options, input, header[1], header[2], output);
+		if (not writeAll(1, &response, sizeof(response)) or not writeAll(1, output.data(), response.length)) {
+			return 0;
+		}
+	}
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+	for (int k = 1; k < argc; k++) {
+		const std::string_view arg = argv[k];
+		if (arg == "--memory" and k + 1 < argc) {
+			char* end;
+			options.memory_mb = std::strtoull(argv[++k], &end, 10);
+			if (*end != '\0' or options.memory_mb == 0) {
+				return false;
+			}
+		} else if (arg == "--no-namespaces") {
+			options.namespaces = false;
+		} else if (arg == "--persistent") {
+			options.persistent = true;
+		} else if (arg[0] != '-' and options.exec == nullptr) {
+			options.exec = argv[k];
+		} else {
+			return false;
+		}
+	}
+	return options.exec != nullptr;
+}
+
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (not parseOptions(argc, argv, options)) {
+		std::fprintf(stderr, "Usage: %s [--memory MB] [--no-namespaces] [--persistent] EXEC\n", argv[0]);
+		return 2;
+	}
+	static_assert(sizeof(Response) == 20);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (not options.namespaces) {
+		if (options.persistent) {
+			execJailed(options, 0);
+		}
+		return serve(options);
+	}
+
+	enterJail(options);
+	// init of the new pid namespace -- everything in the jail dies with it,
+	// and it dies with the launcher (e.g. killed by the referee):
+	const pid_t init = fork();
+	if (init < 0) {
+		fail("fork");
+	}
+	if (init == 0) {
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		if (options.persistent) {
+			execJailed(options, 0);
+		}
+		return serve(options);
+	}
+
+	int status;
+	while (waitpid(init, &status, 0) < 0 and errno == EINTR) {}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
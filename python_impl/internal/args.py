@@ -7,6 +7,24 @@ class ExplicitDefaultsHelpFormatter(argparse.ArgumentDefaultsHelpFormatter):
             return action.help
         return super()._get_help_string(action)
 
+# options of one game, shared by the runner and the tournament (as argparse dests):
+GAME_ARGUMENTS = ["timeout", "match_budget", "height", "width", "wall_count", "round_count", "state_format", "protocol", "sandbox", "memory_limit", "wall_timeout", "move_cache", "spot_check"]
+
+def addGameArguments(arg_parser: argparse.ArgumentParser, timeout: int = 500, height: int = 20, width: int = 30, wall_count: int = 30, round_count: int = 100, move_cache: str | None = None):
+	arg_parser.add_argument('-t', '--timeout', type=int, default=timeout, help='Executables timeout (CPU time of one move, all threads) in milliseconds.')
+	arg_parser.add_argument('--wall-timeout', type=int, default=0, help='Wall time limit of one move in milliseconds, 0 means twice the timeout.')
+	arg_parser.add_argument('--match-budget', type=int, default=0, help='Total CPU time (in milliseconds) of all moves of one player, 0 means no budget. Player that used it only waits.')
+	arg_parser.add_argument('-n', '--height', type=int, default=height, help='Game field height.')
+	arg_parser.add_argument('-m', '--width', type=int, default=width, help='Game field width.')
+	arg_parser.add_argument('-w', '--wall-count', type=int, default=wall_count, help='Approximated wall count.')
+	arg_parser.add_argument('--round-count', type=int, default=round_count, help='Number of rounds after which there will be tie.')
+	arg_parser.add_argument('--state-format', choices=['text', 'binary'], default='text', help='Format of the state sent to execs: "text" (4 chars per tile) or "binary" (header and packed bitplanes).')
+	arg_parser.add_argument('--protocol', choices=['full', 'delta'], default='full', help='Exec protocol: "full" sends whole state every round, "delta" keeps execs running and sends only the opponent move and a checksum.')
+	arg_parser.add_argument('--sandbox', type=str, help='Path of native/sandbox: execs run jailed (namespaces, rlimits, seccomp; execs have to be static). Without it execs run directly.')
+	arg_parser.add_argument('--memory-limit', type=int, default=256, help='Address space limit of sandboxed execs in MB.')
+	arg_parser.add_argument('--move-cache', type=str, default=move_cache, help='SQLite file of memoized moves of execs declared deterministic (OFF_DETERMINISTIC_BOT), "full" protocol only. Empty disables it.')
+	arg_parser.add_argument('--spot-check', type=float, default=0.05, help='Share of memoized moves that are run anyway and compared.')
+
 def getArgParser() -> argparse.ArgumentParser:
 	arg_parser = argparse.ArgumentParser(
 		prog='off_game',
@@ -16,11 +34,7 @@ def getArgParser() -> argparse.ArgumentParser:
 	arg_parser.add_argument('-r', '--red', type=str, help='Red player executable path', required=True)
 	arg_parser.add_argument('-b', '--blue', type=str, help='Blue player executable path', required=True)
 	arg_parser.add_argument('-s', '--silent', action='store_true', help='Don\'t print game state after each round.')
-	arg_parser.add_argument('-t', '--timeout', type=int, default=500, help='Executables timeout in milliseconds.')
-	arg_parser.add_argument('-n', '--height', type=int, default=20, help='Game field height.')
-	arg_parser.add_argument('-m', '--width', type=int, default=30, help='Game field width.')
-	arg_parser.add_argument('-w', '--wall-count', type=int, default=30, help='Approximated wall count.')
-	arg_parser.add_argument('--round-count', type=int, default=100, help='Number of rounds after which there will be tie.')
+	addGameArguments(arg_parser)
 	arg_parser.add_argument('--seed', type=int, help='Game seed (if not given, then seed will be based of system time).')
 	arg_parser.add_argument('--wait', type=int, help='Wait time in millisecond between round.')
 	arg_parser.add_argument('--nice-print', action='store_true', help='Print game state in nice way, where each tile is just one char (not four). It might hide some bullets.')
@@ -0,0 +1,90 @@
+# Build stage of tournaments: submissions are compiled in parallel, binaries are cached
+# under a key made of the source and its local headers (as listed by `g++ -MM`),
+# compiler flags and compiler version, so unchanged submissions are not compiled again.
+
+import hashlib
+import os
+import shutil
+import subprocess
+import time
+from concurrent.futures import ThreadPoolExecutor, as_completed
+from dataclasses import dataclass
+
+COMPILER = "g++"
+DEFAULT_FLAGS = ["-O3", "-static", "-std=c++20"]
+
+@dataclass
+class BuildResult:
+	source: str
+	output: str
+	ok: bool
+	cached: bool
+	seconds: float
+	log: str = ""
+
+_compiler_version = None
+
+def compilerVersion() -> str:
+	global _compiler_version
+	if _compiler_version is None:
+		_compiler_version = subprocess.run([COMPILER, "--version"], capture_output = True, text = True).stdout.split("\n")[0]
+	return _compiler_version
+
+def dependencies(source: str, flags: list[str]) -> list[str]:
+	"""Source and the headers it includes with "" (system headers are covered by the compiler version)."""
+	proc = subprocess.run([COMPILER, *flags, "-MM", source], capture_output = True, text = True)
+	if proc.returncode != 0:
+		return [source]
+	# "target.o: a.cpp b.hpp \\\n c.hpp":
+	return proc.stdout.replace("\\\n", " ").split(":", 1)[1].split()
+
+def buildKey(source: str, flags: list[str]) -> str:
+	digest = hashlib.sha256()
+	digest.update(compilerVersion().encode())
+	digest.update("\0".join(flags).encode())
+	for path in dependencies(source, flags):
+		digest.update(b"\0" + path.encode() + b"\0")
+		with open(path, "rb") as file:
+			digest.update(file.read())
+	return digest.hexdigest()
+
+def build(source: str, output: str, flags: list[str], cache_directory: str | None) -> BuildResult:
+	started = time.monotonic()
+	cached_path = None
+	if cache_directory is not None:
+		cached_path = os.path.join(cache_directory, buildKey(source, flags))
+		if os.path.exists(cached_path):
+			shutil.copy2(cached_path, output)
+			return BuildResult(source, output, True, True, time.monotonic() - started)
+
+	# compiled to a temporary file, so a failed build never leaves a stale or broken output:
+	temporary = f"{output}.{os.getpid()}.tmp"
+	proc = subprocess.run([COMPILER, *flags, source, "-o", temporary], capture_output = True, text = True)
+	seconds = time.monotonic() - started
+	if proc.returncode != 0:
+		if os.path.exists(temporary):
+			os.unlink(temporary)
+		return BuildResult(source, output, False, False, seconds, proc.stderr)
+
+	if cached_path is not None:
+		os.makedirs(cache_directory, exist_ok = True)
+		shutil.copy2(temporary, f"{cached_path}.tmp")
+		os.replace(f"{cached_path}.tmp", cached_path)
+	os.replace(temporary, output)
+	return BuildResult(source, output, True, False, seconds, proc.stderr)
+
+def buildAll(sources: list[str], outputs: list[str], flags: list[str] = DEFAULT_FLAGS,
+             cache_directory: str | None = ".build_cache", jobs: int | None = None) -> list[BuildResult]:
+	"""Builds all sources at once (`jobs` compilers, all cores by default), reports each one as it ends.
+	Results are in the order of sources."""
+	with ThreadPoolExecutor(max_workers = jobs or os.cpu_count()) as pool:
+		futures = {pool.submit(build, source, output, flags, cache_directory): k for k, (source, output) in enumerate(zip(sources, outputs))}
+		results = [None] * len(futures)
+		for future in as_completed(futures):
+			result = future.result()
+			status = "cached" if result.cached else ("ok" if result.ok else "FAILED")
+			print(f"Build {result.source}: {status} ({result.seconds:.2f} s)", flush = True)
+			if not result.ok:
+				print(result.log)
+			results[futures[future]] = result
+	return results
@@ -0,0 +1,335 @@
+# Coordinator and workers of distributed tournaments.
+#
+# Protocol: JSON objects, one per line, over a TCP ("tcp:HOST:PORT") or UNIX ("unix:PATH") socket.
+# A connection starts with {"type": "hello", "token": t} -> {"type": "ack"}, a wrong token closes it.
+# Then worker messages (answered by the coordinator only when noted):
+# * {"type": "request"}                        -> {"type": "job", "job": {...}, "lease": seconds},
+#                                                 {"type": "wait", "seconds": s} or {"type": "done"}
+# * {"type": "heartbeat", "ids": [...]}        -- keeps leases of running jobs
+# * {"type": "result", "id": id, "result": r}  -> {"type": "ack"}
+# * {"type": "error", "id": id, "error": text} -> {"type": "ack"}
+#
+# A job is leased to one worker at a time. Jobs of a dropped worker (closed connection or
+# expired lease) go back to the queue. Results and errors count only from the connection
+# holding the lease, so a late result of a reclaimed job is dropped.
+# Jobs are dicts with an "id"; exec paths in them are resolved on the worker.
+#
+# Security: results go to the result cache, so only trusted workers may connect. A TCP address
+# without a host binds to localhost, and a coordinator with a token (a shared secret, see
+# TOKEN_VARIABLE) accepts only connections that present it. Anyone who can reach a port
+# without a token can play (and fake) games, so don't listen on other hosts without one.
+
+import hmac
+import json
+import os
+import queue
+import socket
+import socketserver
+import subprocess
+import sys
+import threading
+import time
+from collections import deque
+
+# environment variable with the shared token of coordinator and workers:
+TOKEN_VARIABLE = "OFF24_TOKEN"
+
+def parseAddress(address: str) -> tuple[int, str | tuple[str, int]]:
+	""""tcp:HOST:PORT" or "unix:PATH" -> (socket family, address)."""
+	kind, _, rest = address.partition(":")
+	if kind == "unix" and rest:
+		return socket.AF_UNIX, rest
+	if kind == "tcp":
+		host, _, port = rest.rpartition(":")
+		if port.isdigit():
+			return socket.AF_INET, (host or "127.0.0.1", int(port))
+	raise ValueError(f"invalid address: {address} (expected tcp:HOST:PORT or unix:PATH)")
+
+def formatAddress(family: int, address) -> str:
+	if family == socket.AF_UNIX:
+		return f"unix:{address}"
+	return f"tcp:{address[0]}:{address[1]}"
+
+def sendMessage(stream, message: dict):
+	stream.write((json.dumps(message) + "\n").encode())
+	stream.flush()
+
+def readMessage(stream) -> dict | None:
+	line = stream.readline()
+	if not line:
+		return None
+	return json.loads(line)
+
+class _Handler(socketserver.StreamRequestHandler):
+	def handle(self):
+		coordinator = self.server.coordinator
+		try:
+			hello = readMessage(self.rfile)
+		except (OSError, ValueError):
+			return
+		if hello is None or hello.get("type") != "hello" or not coordinator.authorized(hello.get("token")):
+			try:
+				sendMessage(self.wfile, {"type": "error", "error": "wrong token"})
+			except OSError:
+				pass
+			return
+		sendMessage(self.wfile, {"type": "ack"})
+		worker = coordinator.connect()
+		try:
+			while (message := readMessage(self.rfile)) is not None:
+				reply = coordinator.handle(worker, message)
+				if reply is not None:
+					sendMessage(self.wfile, reply)
+		except (OSError, ValueError):
+			pass
+		finally:
+			coordinator.disconnect(worker)
+
+class _TCPServer(socketserver.ThreadingTCPServer):
+	daemon_threads = True
+	allow_reuse_address = True
+
+class _UnixServer(socketserver.ThreadingUnixStreamServer):
+	daemon_threads = True
+
+class Coordinator:
+	"""Job queue served to workers. submit() jobs, then take results() as they come."""
+
+	def __init__(self, address: str, lease_seconds: float = 60, max_attempts: int = 3, token: str | None = None):
+		family, bind_address = parseAddress(address)
+		if family == socket.AF_UNIX and os.path.exists(bind_address):
+			os.unlink(bind_address)
+		server_class = _UnixServer if family == socket.AF_UNIX else _TCPServer
+		self.server = server_class(bind_address, _Handler)
+		self.server.coordinator = self
+		self.address = formatAddress(family, self.server.server_address)
+		self.family = family
+
+		self.token = token
+		self.lease_seconds = lease_seconds
+		self.max_attempts = max_attempts
+		self.lock = threading.Lock()
+		self.jobs = {}
+		self.pending = deque()
+		# job id -> (worker, deadline)
+		self.leases = {}
+		self.attempts = {}
+		self.finished = set()
+		self.closing = False
+		self.next_worker = 0
+		# (job, result, error) of finished jobs:
+		self.finished_queue = queue.Queue()
+
+		self.thread = threading.Thread(target = self.server.serve_forever, daemon = True)
+		self.thread.start()
+
+	def submit(self, jobs: list[dict]):
+		with self.lock:
+			for job in jobs:
+				if job["id"] in self.jobs:
+					continue
+				self.jobs[job["id"]] = job
+				self.attempts[job["id"]] = 0
+				self.pending.append(job["id"])
+
+	def unfinished(self) -> int:
+		with self.lock:
+			return len(self.jobs) - len(self.finished)
+
+	def results(self, poll_seconds: float = 1):
+		"""Yields (job, result, error) of finished jobs until all submitted jobs are finished."""
+		while self.unfinished() > 0 or not self.finished_queue.empty():
+			try:
+				yield self.finished_queue.get(timeout = poll_seconds)
+			except queue.Empty:
+				with self.lock:
+					self._reclaimExpired()
+
+	def close(self):
+		"""Workers get "done" on their next request."""
+		with self.lock:
+			self.closing = True
+
+	def shutdown(self):
+		self.close()
+		self.server.shutdown()
+		self.server.server_close()
+		if self.family == socket.AF_UNIX:
+			try:
+				os.unlink(self.server.server_address)
+			except OSError:
+				pass
+
+	# called from connection threads:
+
+	def authorized(self, token) -> bool:
+		if not self.token:
+			return True
+		return isinstance(token, str) and hmac.compare_digest(token.encode(), self.token.encode())
+
+	def connect(self) -> int:
+		with self.lock:
+			self.next_worker += 1
+			return self.next_worker
+
+	def disconnect(self, worker: int):
+		with self.lock:
+			for job_id, (owner, _) in list(self.leases.items()):
+				if owner == worker:
+					self._requeue(job_id, f"worker {worker} dropped")
+
+	def handle(self, worker: int, message: dict) -> dict | None:
+		kind = message.get("type")
+		with self.lock:
+			if kind == "request":
+				self._reclaimExpired()
+				if self.pending:
+					job_id = self.pending.popleft()
+					self.leases[job_id] = (worker, time.monotonic() + self.lease_seconds)
+					self.attempts[job_id] += 1
+					return {"type": "job", "job": self.jobs[job_id], "lease": self.lease_seconds}
+				if self.closing:
+					return {"type": "done"}
+				return {"type": "wait", "seconds": 1}
+
+			if kind == "heartbeat":
+				for job_id in message.get("ids", []):
+					if job_id in self.leases and self.leases[job_id][0] == worker:
+						self.leases[job_id] = (worker, time.monotonic() + self.lease_seconds)
+				return None
+
+			if kind == "result":
+				job_id = message["id"]
+				if job_id in self.leases and self.leases[job_id][0] == worker:
+					self._finish(job_id, message["result"], None)
+				return {"type": "ack"}
+
+			if kind == "error":
+				job_id = message["id"]
+				if job_id in self.leases and self.leases[job_id][0] == worker:
+					self._requeue(job_id, message.get("error", "error"))
+				return {"type": "ack"}
+
+		return {"type": "error", "error": f"unknown message type: {kind}"}
+
+	# with the lock held:
+
+	def _finish(self, job_id, result, error):
+		if job_id not in self.jobs or job_id in self.finished:
+			return
+		self.finished.add(job_id)
+		self.leases.pop(job_id, None)
+		if job_id in self.pending:
+			self.pending.remove(job_id)
+		self.finished_queue.put((self.jobs[job_id], result, error))
+
+	def _requeue(self, job_id, reason: str):
+		del self.leases[job_id]
+		if self.attempts[job_id] >= self.max_attempts:
+			print(f"Warning: job {job_id} failed {self.attempts[job_id]} times ({reason}) -- giving up.")
+			self._finish(job_id, None, reason)
+			return
+		print(f"Warning: job {job_id} will be retried ({reason}).")
+		self.pending.appendleft(job_id)
+
+	def _reclaimExpired(self):
+		now = time.monotonic()
+		for job_id, (_, deadline) in list(self.leases.items()):
+			if deadline < now:
+				self._requeue(job_id, "lease expired")
+
+def runJob(job: dict) -> str:
+	"""Plays one game of a job ({"red", "blue", "args": runner arguments}), returns RED, BLUE or TIE."""
+	from .utils import runWithArgs
+	from types import SimpleNamespace
+
+	args = SimpleNamespace(
+		red = job["red"], blue = job["blue"],
+		silent = True, wait = None, nice_print = False, clear_terminal = False,
+		**job["args"],
+	)
+	return runWithArgs(args)
+
+def _heartbeats(stream, lock, running: dict, stop: threading.Event, interval: float):
+	while not stop.wait(interval):
+		with lock:
+			if running:
+				try:
+					sendMessage(stream, {"type": "heartbeat", "ids": list(running)})
+				except OSError:
+					return
+
+def runWorker(address: str, retry_seconds: float = 30, token: str | None = None) -> int:
+	"""Pulls and plays jobs until the coordinator is done. Returns number of played jobs."""
+	family, connect_address = parseAddress(address)
+	played = 0
+	deadline = time.monotonic() + retry_seconds
+	while True:
+		try:
+			connection = socket.socket(family, socket.SOCK_STREAM)
+			connection.connect(connect_address)
+		except OSError:
+			connection.close()
+			if time.monotonic() > deadline:
+				print(f"Worker: can't connect to {address}.", file = sys.stderr)
+				return played
+			time.sleep(1)
+			continue
+
+		stream = connection.makefile("rwb")
+		lock = threading.Lock()
+		running = {}
+		stop = threading.Event()
+		heartbeat = None
+		try:
+			sendMessage(stream, {"type": "hello", "token": token})
+			reply = readMessage(stream)
+			if reply is not None and reply["type"] == "error":
+				print(f"Worker: {address} refused the connection ({reply['error']}).", file = sys.stderr)
+				return played
+			while True:
+				with lock:
+					sendMessage(stream, {"type": "request"})
+					reply = readMessage(stream)
+				if reply is None:
+					break
+				if reply["type"] == "done":
+					return played
+				if reply["type"] == "wait":
+					time.sleep(reply["seconds"])
+					continue
+
+				job = reply["job"]
+				if heartbeat is None:
+					heartbeat = threading.Thread(target = _heartbeats, daemon = True,
+					                             args = (stream, lock, running, stop, reply["lease"] / 3))
+					heartbeat.start()
+				with lock:
+					running[job["id"]] = job
+				try:
+					message = {"type": "result", "id": job["id"], "result": runJob(job)}
+				except Exception as error:
+					message = {"type": "error", "id": job["id"], "error": repr(error)}
+				with lock:
+					del running[job["id"]]
+					sendMessage(stream, message)
+					readMessage(stream)
+				played += 1
+		except (OSError, ValueError):
+			pass
+		finally:
+			stop.set()
+			connection.close()
+		# coordinator went away -- it may come back (e.g. a restarted tournament):
+		deadline = time.monotonic() + retry_seconds
+
+def startLocalWorkers(address: str, count: int, token: str | None = None) -> list[subprocess.Popen]:
+	"""Worker processes on this host (python_impl/worker.py), the token goes in the environment."""
+	script = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "worker.py")
+	env = dict(os.environ)
+	if token:
+		env[TOKEN_VARIABLE] = token
+	return [
+		subprocess.Popen([sys.executable, script, "--connect", address], stdout = subprocess.DEVNULL, env = env)
+		for _ in range(count)
+	]
@@ -0,0 +1,95 @@
+# Journal of a tournament: every finished game is appended (and fsynced) as one JSON line,
+# so a tournament that crashed or was preempted resumes by replaying it -- the scheduling is
+# deterministic, so a restarted run asks for the same games and plays only the missing ones.
+# The first line is a fingerprint of the tournament (format, seeds, users, options); a journal
+# of another tournament is set aside (as <path>.old) instead of being resumed.
+# An entry is used only for the same job id, binaries and game options.
+# A tournament that completes removes its journal.
+
+import hashlib
+import json
+import os
+
+from .result_cache import fileDigest
+
+def jobFingerprint(job: dict) -> str:
+	content = json.dumps({
+		"id": job["id"],
+		"red": fileDigest(job["red"]),
+		"blue": fileDigest(job["blue"]),
+		"args": job["args"],
+	}, sort_keys = True)
+	return hashlib.sha256(content.encode()).hexdigest()
+
+def tournamentFingerprint(options: dict) -> str:
+	return hashlib.sha256(json.dumps(options, sort_keys = True).encode()).hexdigest()
+
+def _journalHeader(path: str) -> str | None:
+	"""Tournament fingerprint of an existing journal (None if it has none)."""
+	with open(path) as file:
+		try:
+			return json.loads(file.readline())["tournament"]
+		except (ValueError, KeyError, TypeError):
+			return None
+
+class Journal:
+	def __init__(self, path: str, tournament: str, fresh: bool = False):
+		"""tournament: fingerprint of the tournament (see tournamentFingerprint)."""
+		self.path = path
+		# job id -> (fingerprint, result):
+		self.entries = {}
+		# path of a journal of another tournament that was set aside:
+		self.set_aside = None
+		if fresh and os.path.exists(path):
+			os.unlink(path)
+		if os.path.exists(path) and _journalHeader(path) != tournament:
+			self.set_aside = f"{path}.old"
+			os.replace(path, self.set_aside)
+		if os.path.exists(path):
+			with open(path) as file:
+				file.readline()
+				for line in file:
+					try:
+						entry = json.loads(line)
+						self.entries[entry["id"]] = (entry["fingerprint"], entry["result"])
+					except (ValueError, KeyError):
+						# torn last line of a crash
+						continue
+		self.resumed = len(self.entries)
+		new = not os.path.exists(path)
+		torn = False
+		if os.path.exists(path) and os.path.getsize(path) > 0:
+			with open(path, "rb") as file:
+				file.seek(-1, os.SEEK_END)
+				torn = file.read(1) != b"\n"
+		self.file = open(path, "a")
+		if torn:
+			# new entries start on a line of their own
+			self.file.write("\n")
+		if new:
+			self.file.write(json.dumps({"tournament": tournament}) + "\n")
+			self.file.flush()
+
+	def lookup(self, job: dict) -> str | None:
+		entry = self.entries.get(job["id"])
+		if entry is None or entry[0] != jobFingerprint(job):
+			return None
+		return entry[1]
+
+	def append(self, job: dict, result: str):
+		fingerprint = jobFingerprint(job)
+		if self.entries.get(job["id"]) == (fingerprint, result):
+			return
+		self.entries[job["id"]] = (fingerprint, result)
+		self.file.write(json.dumps({"id": job["id"], "fingerprint": fingerprint, "result": result}) + "\n")
+		self.file.flush()
+		os.fsync(self.file.fileno())
+
+	def close(self):
+		self.file.close()
+
+	def remove(self):
+		"""The tournament completed, a next run starts over."""
+		self.close()
+		if os.path.exists(self.path):
+			os.unlink(self.path)
@@ -10,6 +10,18 @@ BULLET_DOWN  = "v"
 BULLET_RIGHT = ">"
 BULLET_LEFT  = "<"
 
+# Direction indexes used by the bots (and in the state checksum):
+DIRECTION_INDEX = {(-1, 0): 0, (1, 0): 1, (0, -1): 2, (0, 1): 3}
+
+U64_MASK = (1 << 64) - 1
+
+def mix64(x: int) -> int:
+	"""splitmix64 finalizer"""
+	x = (x + 0x9E3779B97F4A7C15) & U64_MASK
+	x = ((x ^ (x >> 30)) * 0xBF58476D1CE4E5B9) & U64_MASK
+	x = ((x ^ (x >> 27)) * 0x94D049BB133111EB) & U64_MASK
+	return x ^ (x >> 31)
+
 class TileType(Enum):
 	STANDARD = 0
 	WALL     = 1
@@ -68,6 +80,72 @@ class MoveProfile(Enum):
 class Move:
 	profiles: List[MoveProfile]
 
+# indexed with DIRECTION_INDEX, which is also the char slot in a tile:
+BULLET_CHARS = [BULLET_UP, BULLET_DOWN, BULLET_LEFT, BULLET_RIGHT]
+
+class BoardRenderer:
+	"""
+	Renders the board for GameLogic.showStr.
+	Walls never change, so the rendered walls are kept in a static buffer
+	and only cells with players or bullets are patched (and restored on the next call).
+	Result is cached until the game state changes.
+	"""
+
+	def __init__(self, logic: "GameLogic", nice: bool):
+		self.nice = nice
+		self.cell_width = 1 if nice else 4
+		self.row_width = logic.m * self.cell_width + 1
+		self.tile_chars = [[tile.showStr() for tile in row] for row in logic.tiles]
+
+		static = []
+		for row in self.tile_chars:
+			for c in row:
+				static.append(c if nice else c + "   ")
+			static.append("\n")
+		self.static = "".join(static).encode()
+
+		self.buffer = bytearray(self.static)
+		self.dirty = []
+		self.version = None
+		self.rendered = ""
+
+	def render(self, logic: "GameLogic") -> str:
+		if self.version == logic.version:
+			return self.rendered
+
+		width = self.cell_width
+		for offset in self.dirty:
+			self.buffer[offset:offset + width] = self.static[offset:offset + width]
+
+		# char slots of cells that have something on them:
+		cells = {}
+		def slotsAt(position):
+			if position not in cells:
+				x, y = position
+				cells[position] = [self.tile_chars[x][y], " ", " ", " "]
+			return cells[position]
+
+		for player in logic.players:
+			slotsAt(player.position)[0] = player.show()
+		for bullet in logic.bullets:
+			index = DIRECTION_INDEX[bullet.direction]
+			slotsAt(bullet.position)[index] = BULLET_CHARS[index]
+
+		self.dirty = []
+		for (x, y), slots in cells.items():
+			offset = x * self.row_width + y * width
+			if self.nice:
+				# last non empty slot is visible:
+				text = next((c for c in reversed(slots) if c != " "), " ")
+			else:
+				text = "".join(slots)
+			self.buffer[offset:offset + width] = text.encode()
+			self.dirty.append(offset)
+
+		self.version = logic.version
+		self.rendered = self.buffer.decode()
+		return self.rendered
+
 class GameLogic:
 	def __init__(self, n: int, m: int, wall_count: int, seed = None):
 		self.n = n
@@ -75,8 +153,16 @@ class GameLogic:
 
 		self.tiles = [[Tile() for _ in range(m)] for _ in range(n)]
 		self.bullets = []
+		# bullet_grid[direction index][x][y] -- number of bullets there,
+		# kept in sync with self.bullets, so hit checks are O(1):
+		self.bullet_grid = [[[0] * m for _ in range(n)] for _ in range(4)]
 		self.players = [Player(PlayersID.RED, (1, 1), (0, 1)), Player(PlayersID.BLUE, (n-2, m-2), (0, 1))]
 
+		# bumped on every state change, used by caches:
+		self.version = 0
+		self.renderers = {}
+		self.planes_cache = (None, b"")
+
 		if (seed is not None):
 			random.seed(seed)
 		for _ in range(wall_count // 2):
@@ -96,19 +182,44 @@ class GameLogic:
 			self.tiles[0][i].type   = TileType.WALL
 			self.tiles[n-1][i].type = TileType.WALL
 
+		# walls never change, so their plane is packed once:
+		self.walls_plane = 0
+		for i in range(n):
+			for j in range(m):
+				if self.tiles[i][j].type == TileType.WALL:
+					self.walls_plane |= 1 << (i * m + j)
+
+	def addBullet(self, bullet: Bullet):
+		x, y = bullet.position
+		self.bullets.append(bullet)
+		self.bullet_grid[DIRECTION_INDEX[bullet.direction]][x][y] += 1
+
+	def isBulletAt(self, position: Tuple[int, int]) -> bool:
+		x, y = position
+		return any(grid[x][y] > 0 for grid in self.bullet_grid)
+
 	def moveBulletsOneStep(self):
+		moved = []
 		for bullet in self.bullets:
 			x, y = bullet.position
 			dx, dy = bullet.direction
 			new_x, new_y = x + dx, y + dy
 
+			self.bullet_grid[DIRECTION_INDEX[bullet.direction]][x][y] -= 1
+
 			if (new_x < 0 or new_x >= self.n or new_y < 0 or new_y >= self.m):
-				self.bullets.remove(bullet)
+				continue
+
+			if self.tiles[new_x][new_y].type == TileType.WALL:
+				bullet.direction = (-dx, -dy)
 			else:
-				if self.tiles[new_x][new_y].type == TileType.WALL:
-					bullet.direction = (-dx, -dy)
-				else:
-					bullet.position = (new_x, new_y)
+				bullet.position = (new_x, new_y)
+
+			x, y = bullet.position
+			self.bullet_grid[DIRECTION_INDEX[bullet.direction]][x][y] += 1
+			moved.append(bullet)
+
+		self.bullets = moved
 
 	def applyMove(self, move: Move) -> List[PlayersID]:
 		"""Return list of hits"""
@@ -126,6 +237,8 @@ class GameLogic:
 		if len(output) > 0:
 			return output
 
+		self.version += 1
+
 		for (player, profile) in zip(self.players, move.profiles):
 			player.old_position = player.position
 			match profile:
@@ -138,13 +251,13 @@ class GameLogic:
 				case MoveProfile.MOVE_RIGHT:
 					player.position = (player.position[0], min(player.position[1] + 1, self.m - 1))
 				case MoveProfile.SHOOT_UP:
-					self.bullets.append(Bullet(player.position, (-1, 0)))
+					self.addBullet(Bullet(player.position, (-1, 0)))
 				case MoveProfile.SHOOT_DOWN:
-					self.bullets.append(Bullet(player.position, (1, 0)))
+					self.addBullet(Bullet(player.position, (1, 0)))
 				case MoveProfile.SHOOT_LEFT:
-					self.bullets.append(Bullet(player.position, (0, -1)))
+					self.addBullet(Bullet(player.position, (0, -1)))
 				case MoveProfile.SHOOT_RIGHT:
-					self.bullets.append(Bullet(player.position, (0, 1)))
+					self.addBullet(Bullet(player.position, (0, 1)))
 				case MoveProfile.WAIT:
 					pass
 				case _:
@@ -159,10 +272,9 @@ class GameLogic:
 		self.moveBulletsOneStep()
 
 		for player in self.players:
-			for bullet in self.bullets:
-				if player.position == bullet.position:
-					# hit
-					output.append(player.player_type)
+			if self.isBulletAt(player.position):
+				# hit
+				output.append(player.player_type)
 
 		# Eliminate duplicates:
 		output = list(dict.fromkeys(output))
@@ -170,42 +282,49 @@ class GameLogic:
 		return output
 
 	def showStr(self, nice: bool) -> str:
-		tiles_str = [[[" ", " ", " ", " "] for i in range(self.m)] for _ in range(self.n)]
-
-		for i in range(len(self.tiles)):
-			for j in range(len(self.tiles[i])):
-				tiles_str[i][j][0] = self.tiles[i][j].showStr()
+		if nice not in self.renderers:
+			self.renderers[nice] = BoardRenderer(self, nice)
+		return self.renderers[nice].render(self)
+
+	def stateChecksum(self) -> int:
+		"""
+		Order independent hash of bullets and players, used by the delta protocol.
+		Each distinct (cell, direction) bullet contributes mix64(1 + 4 * cell + dir),
+		players contribute mix64((1 << 32) + cell) (red) and mix64((2 << 32) + cell) (blue),
+		where cell = x * m + y. Contributions are summed modulo 2^64.
+		"""
+		keys = set()
+		for bullet in self.bullets:
+			x, y = bullet.position
+			keys.add(1 + 4 * (x * self.m + y) + DIRECTION_INDEX[bullet.direction])
 
-		for player in self.players:
+		checksum = sum(mix64(key) for key in keys)
+		for (salt, player) in zip([1, 2], self.players):
 			x, y = player.position
-			tiles_str[x][y][0] = player.show()
-
+			checksum += mix64((salt << 32) + x * self.m + y)
+		return checksum & U64_MASK
+
+	def packPlanes(self) -> bytes:
+		"""
+		Packed bitplanes: walls, up, down, left and right bullets, red, blue.
+		Cell (x, y) is bit x * m + y. Each plane is ceil(n * m / 64)
+		little endian u64 words.
+		"""
+		if self.planes_cache[0] == self.version:
+			return self.planes_cache[1]
+
+		planes = [self.walls_plane, 0, 0, 0, 0, 0, 0]
 		for bullet in self.bullets:
 			x, y = bullet.position
-			match bullet.direction:
-				case (-1, 0):
-					tiles_str[x][y][0] = BULLET_UP
-				case (1, 0):
-					tiles_str[x][y][1] = BULLET_DOWN
-				case (0, -1):
-					tiles_str[x][y][2] = BULLET_LEFT
-				case (0, 1):
-					tiles_str[x][y][3] = BULLET_RIGHT
-
-		if not nice:
-			return "".join([item for row in tiles_str for tile in (row+["\n"]) for item in tile]) 
-		else:
-			out = []
-			for row in tiles_str:
-				for tile in row:
-					to_add = " "
-					for c in tile[::-1]:
-						if c != " ":
-							to_add = c
-							break
-					out.append(to_add)
-				out.append("\n")
-			return ''.join(out)
+			planes[1 + DIRECTION_INDEX[bullet.direction]] |= 1 << (x * self.m + y)
+		for (plane, player) in zip([5, 6], self.players):
+			x, y = player.position
+			planes[plane] |= 1 << (x * self.m + y)
+
+		plane_bytes = 8 * ((self.n * self.m + 63) // 64)
+		packed = b"".join(plane.to_bytes(plane_bytes, "little") for plane in planes)
+		self.planes_cache = (self.version, packed)
+		return packed
 
 	def showForUser(self, nice: bool) -> str:
 		output = []
@@ -0,0 +1,97 @@
+# Memoized moves of deterministic execs ("full" protocol only -- a delta exec keeps its own state).
+# An exec declares itself deterministic with OFF_DETERMINISTIC_BOT (solutions/common/protocol.hpp),
+# which leaves a marker string in its binary. Key of a move is a hash of the exec binary and the
+# exact state it was sent (clock line included), so e.g. opening rounds of a seed repeated over
+# a tournament are answered without running the exec. CPU time of the original run is stored and
+# charged again, so a game plays out the same with or without the cache.
+# Some hits are still run (spot checks); an exec caught answering differently loses its entries
+# and is not memoized any more. Moves live in one SQLite file, shared by local workers.
+
+import hashlib
+import random
+import sqlite3
+
+from .result_cache import fileDigest
+
+DETERMINISTIC_MARKER = b"OFF_DETERMINISTIC_BOT"
+
+# exec digest -> has the marker:
+_declared = {}
+
+def declaresDeterministic(path: str) -> bool:
+	digest = fileDigest(path)
+	if digest is None:
+		return False
+	if digest not in _declared:
+		found = False
+		tail = b""
+		with open(path, "rb") as file:
+			while chunk := file.read(1 << 20):
+				if DETERMINISTIC_MARKER in tail + chunk:
+					found = True
+					break
+				tail = chunk[-len(DETERMINISTIC_MARKER):]
+		_declared[digest] = found
+	return _declared[digest]
+
+class MoveCache:
+	def __init__(self, path: str, spot_check: float = 0.05):
+		self.spot_check = spot_check
+		# spot checks must not touch the random state of anything else:
+		self.rng = random.Random()
+		self.db = sqlite3.connect(path, timeout = 60, isolation_level = None)
+		self.db.execute("PRAGMA journal_mode = WAL")
+		self.db.execute("PRAGMA synchronous = NORMAL")
+		self.db.execute("CREATE TABLE IF NOT EXISTS moves (key TEXT PRIMARY KEY, exec TEXT, move INTEGER, cpu_ms REAL)")
+		self.db.execute("CREATE TABLE IF NOT EXISTS nondeterministic (exec TEXT PRIMARY KEY)")
+		self.hits = 0
+		self.spot_checks = 0
+		self.mismatches = 0
+
+	def memoized(self, path: str) -> bool:
+		"""Whether moves of the exec are memoized: declared deterministic and not caught otherwise."""
+		if not declaresDeterministic(path):
+			return False
+		return self.db.execute("SELECT 1 FROM nondeterministic WHERE exec = ?", (fileDigest(path),)).fetchone() is None
+
+	def key(self, path: str, state: bytes) -> str:
+		return hashlib.sha256(fileDigest(path).encode() + b"\0" + state).hexdigest()
+
+	def get(self, path: str, state: bytes) -> tuple[int, float] | None:
+		"""(move, CPU ms of its run) for a repeated state."""
+		row = self.db.execute("SELECT move, cpu_ms FROM moves WHERE key = ?", (self.key(path, state),)).fetchone()
+		if row is not None:
+			self.hits += 1
+		return row
+
+	def spotCheck(self) -> bool:
+		"""Whether a hit should be run anyway (and compared)."""
+		if self.rng.random() < self.spot_check:
+			self.spot_checks += 1
+			return True
+		return False
+
+	def put(self, path: str, state: bytes, move: int, cpu_ms: float):
+		self.db.execute("INSERT OR IGNORE INTO moves VALUES (?, ?, ?, ?)", (self.key(path, state), fileDigest(path), move, cpu_ms))
+
+	def mismatch(self, path: str):
+		"""The exec answered a state differently than before -- it is not deterministic."""
+		self.mismatches += 1
+		digest = fileDigest(path)
+		self.db.execute("BEGIN")
+		self.db.execute("INSERT OR IGNORE INTO nondeterministic VALUES (?)", (digest,))
+		self.db.execute("DELETE FROM moves WHERE exec = ?", (digest,))
+		self.db.execute("COMMIT")
+
+	def close(self):
+		self.db.close()
+
+# path -> MoveCache, one connection per process:
+_opened = {}
+
+def openMoveCache(path: str, spot_check: float) -> MoveCache:
+	cache = _opened.get(path)
+	if cache is None:
+		cache = _opened[path] = MoveCache(path, spot_check)
+	cache.spot_check = spot_check
+	return cache
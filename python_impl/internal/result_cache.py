@@ -0,0 +1,103 @@
+# Content addressed cache of game results.
+# Key is a hash of both exec binaries (by content, colors matter), the game options
+# (seed, board size, limits, protocol), the sandbox binary (if any) and the referee version,
+# so a result is reused only for the very same game. Every result is a small file named by its key.
+
+import ast
+import hashlib
+import json
+import os
+
+# module playing a game of a job (distributed.runJob), the referee is everything it imports:
+_REFEREE_ROOT = "distributed.py"
+
+def _refereeSources() -> list[str]:
+	"""Files of internal/ that _REFEREE_ROOT imports (relative imports, transitively), sorted."""
+	directory = os.path.dirname(os.path.abspath(__file__))
+	found = set()
+	pending = [_REFEREE_ROOT]
+	while pending:
+		name = pending.pop()
+		if name in found:
+			continue
+		found.add(name)
+		with open(os.path.join(directory, name), "rb") as file:
+			tree = ast.parse(file.read())
+		for node in ast.walk(tree):
+			if isinstance(node, ast.ImportFrom) and node.level == 1 and node.module:
+				pending.append(node.module.split(".")[0] + ".py")
+	return sorted(found)
+
+def _refereeVersion() -> str:
+	"""Hash of the referee sources -- any change of the rules or protocols invalidates the cache."""
+	digest = hashlib.sha256()
+	directory = os.path.dirname(os.path.abspath(__file__))
+	for name in _refereeSources():
+		with open(os.path.join(directory, name), "rb") as file:
+			digest.update(name.encode())
+			digest.update(file.read())
+	return digest.hexdigest()
+
+REFEREE_VERSION = _refereeVersion()
+
+# path -> (size, mtime, digest):
+_digests = {}
+
+def fileDigest(path: str) -> str | None:
+	"""sha256 of a file (None if missing), rehashed only when its size or mtime change."""
+	try:
+		stat = os.stat(path)
+	except OSError:
+		return None
+	known = _digests.get(path)
+	if known is not None and known[:2] == (stat.st_size, stat.st_mtime_ns):
+		return known[2]
+	digest = hashlib.sha256()
+	with open(path, "rb") as file:
+		while chunk := file.read(1 << 20):
+			digest.update(chunk)
+	_digests[path] = (stat.st_size, stat.st_mtime_ns, digest.hexdigest())
+	return digest.hexdigest()
+
+class ResultCache:
+	def __init__(self, directory: str):
+		self.directory = directory
+
+	def key(self, job: dict) -> str | None:
+		"""None if a binary is missing (such game is not cached)."""
+		red, blue = fileDigest(job["red"]), fileDigest(job["blue"])
+		if red is None or blue is None:
+			return None
+		content = {"red": red, "blue": blue, "args": job["args"], "referee": REFEREE_VERSION}
+		if job["args"].get("sandbox"):
+			# limits are enforced by the sandbox, so its binary matters as much as the options:
+			content["sandbox"] = fileDigest(job["args"]["sandbox"])
+			if content["sandbox"] is None:
+				return None
+		content = json.dumps(content, sort_keys = True)
+		return hashlib.sha256(content.encode()).hexdigest()
+
+	def path(self, key: str) -> str:
+		return os.path.join(self.directory, key[:2], key)
+
+	def get(self, job: dict) -> str | None:
+		key = self.key(job)
+		if key is None:
+			return None
+		try:
+			with open(self.path(key)) as file:
+				return json.load(file)["result"]
+		except (OSError, ValueError, KeyError):
+			return None
+
+	def put(self, job: dict, result: str):
+		key = self.key(job)
+		if key is None:
+			return
+		path = self.path(key)
+		os.makedirs(os.path.dirname(path), exist_ok = True)
+		# atomic, so concurrent tournaments (or a crash) never leave a broken entry:
+		temporary = f"{path}.{os.getpid()}.tmp"
+		with open(temporary, "w") as file:
+			json.dump({"result": result, "red": job["red"], "blue": job["blue"], "args": job["args"]}, file)
+		os.replace(temporary, path)
@@ -2,22 +2,309 @@
 # File containing Game class which is responsible for simulating
 # the game played by two "exec" players
 
+import os
+import time
+import struct
+import select
 import subprocess
-import shutil
 from dataclasses import dataclass
 
 from .logic import *
+from .move_cache import MoveCache
 
-RUN_IN_ISOLATE = False
+# Protocols:
+# * "full"  -- exec is started for every move, gets whole state on stdin
+#              and prints its move.
+# * "delta" -- exec is started once and kept alive. First message is the whole
+#              state (same as in "full"). After printing a move, exec gets one line
+#              per round: "<round number> <opponent move> <checksum> <clock>", where
+#              checksum is GameLogic.stateChecksum of the state after both moves
+#              and clock is the same as in the state formats.
+#              Exec may answer "resync" instead of a move, then it gets the whole
+#              state again and has to answer with a move.
+#              Execs that exit after one move are restarted with the whole state,
+#              so they still work (but without any gain).
+PROTOCOLS = ["full", "delta"]
+
+# State formats (used for "full" states in both protocols):
+# * "text"   -- n, m, the board with 4 chars per tile, round number, player char
+#               and the clock line.
+# * "binary" -- 24 byte header: b"OFFB", u16 n, u16 m, u32 round number,
+#               player char, 3 zero bytes, u32 time limit, u32 remaining budget;
+#               followed by GameLogic.packPlanes. All numbers are little endian.
+#
+# Clock (see Game.moveClock): "<time limit of this move in ms> <remaining match budget in ms>",
+# remaining budget is 0 when there is no match budget.
+#
+# Time limit of a move is a limit of CPU time of the exec (user + system, all its threads) --
+# watched while it runs, so execs burning several cores are stopped in time. Wall time of a move
+# has its own, looser limit (wall_timeout_ms), so honest execs on a loaded host are not timed out.
+# Both are violations (recorded in Game.violations) and the move is WAIT.
+# Match budget is charged with CPU time.
+STATE_FORMATS = ["text", "binary"]
+BINARY_MAGIC = b"OFFB"
+
+# Sandbox (native/sandbox, optional): jail set up once per game per exec -- namespaces,
+# rlimits (memory_mb of address space) and a seccomp filter; states and moves go through pipes.
+# "full" protocol talks to a long living launcher that runs the exec for every move,
+# "delta" protocol starts the long living exec itself inside the jail.
+SANDBOX_OK, SANDBOX_CPU_LIMIT, SANDBOX_ERROR, SANDBOX_SPAWN, SANDBOX_WALL_LIMIT = range(5)
+SANDBOX_RESPONSE = struct.Struct("<IiIII")
+# launcher's own share of a move (jail is already prepared, so it is small):
+SANDBOX_GRACE_S = 1.0
+
+CLOCK_TICKS = os.sysconf("SC_CLK_TCK")
+# how often CPU time of a running exec is checked:
+CPU_POLL_S = 0.005
+
+def processCpuSeconds(pid: int) -> float | None:
+	"""CPU time of a running process (all threads, clock tick resolution), None if it is gone."""
+	try:
+		with open(f"/proc/{pid}/stat") as file:
+			# utime and stime are fields 14 and 15, the command (2) may contain spaces:
+			fields = file.read().rsplit(")", 1)[1].split()
+		return (int(fields[11]) + int(fields[12])) / CLOCK_TICKS
+	except (OSError, IndexError, ValueError):
+		return None
+
+@dataclass
+class Violation:
+	round_number: int
+	player: PlayersID
+	kind: str # "cpu" or "wall"
+	cpu_ms: float
+	wall_ms: float
+
+@dataclass
+class ExecRun:
+	output: bytes
+	returncode: int
+	cpu_ms: float
+	wall_ms: float
+	violation: str | None = None
+
+def runTimed(command: str | list[str], state: bytes, cpu_limit_ms: int, wall_limit_ms: int) -> ExecRun:
+	"""One run of an exec: state to its stdin, its stdout back, within both time limits.
+	CPU time is measured by wait4 (rusage of the exec)."""
+	started = time.monotonic()
+	proc = subprocess.Popen(command, stdin = subprocess.PIPE, stdout = subprocess.PIPE, bufsize = 0)
+	os.set_blocking(proc.stdin.fileno(), False)
+	pending = memoryview(state)
+	chunks = []
+	violation = None
+
+	def overLimit() -> str | None:
+		if time.monotonic() - started >= wall_limit_ms / 1000:
+			return "wall"
+		cpu = processCpuSeconds(proc.pid)
+		if cpu is not None and cpu * 1000 > cpu_limit_ms:
+			return "cpu"
+		return None
+
+	if len(pending) == 0:
+		proc.stdin.close()
+	while violation is None:
+		writers = [] if proc.stdin.closed else [proc.stdin]
+		remaining = wall_limit_ms / 1000 - (time.monotonic() - started)
+		readable, writable, _ = select.select([proc.stdout], writers, [], max(min(remaining, CPU_POLL_S), 0))
+		if writable:
+			try:
+				pending = pending[os.write(proc.stdin.fileno(), pending):]
+			except BlockingIOError:
+				pass
+			except OSError:
+				# exec does not read its input
+				pending = pending[len(pending):]
+			if len(pending) == 0:
+				proc.stdin.close()
+		if readable:
+			chunk = os.read(proc.stdout.fileno(), 65536)
+			if not chunk:
+				break
+			chunks.append(chunk)
+		violation = overLimit()
+
+	# stdout may be closed before the exit, which has to come within the limits too:
+	while violation is None and os.waitid(os.P_PID, proc.pid, os.WEXITED | os.WNOHANG | os.WNOWAIT) is None:
+		time.sleep(0.0001)
+		violation = overLimit()
+	if violation is not None:
+		proc.kill()
+	for pipe in (proc.stdin, proc.stdout):
+		if not pipe.closed:
+			pipe.close()
+	_, status, usage = os.wait4(proc.pid, 0)
+	proc.returncode = os.waitstatus_to_exitcode(status)
+
+	cpu_ms = (usage.ru_utime + usage.ru_stime) * 1000
+	if violation is None and cpu_ms > cpu_limit_ms:
+		violation = "cpu"
+	return ExecRun(b"".join(chunks), proc.returncode, cpu_ms, (time.monotonic() - started) * 1000, violation)
+
+class BotProcess:
+	"""Long living exec, used by the delta protocol."""
+
+	def __init__(self, command: str | list[str], sandboxed: bool = False):
+		self.proc = subprocess.Popen(command, stdin = subprocess.PIPE, stdout = subprocess.PIPE, bufsize = 0)
+		self.buffer = b""
+		# a sandboxed exec is a child of the launcher (found when its CPU time is first needed)
+		self.exec_pid = None if sandboxed else self.proc.pid
+
+	def cpuSeconds(self) -> float:
+		"""CPU time of the exec so far (0 if it is gone)."""
+		if self.exec_pid is None:
+			try:
+				with open(f"/proc/{self.proc.pid}/task/{self.proc.pid}/children") as file:
+					self.exec_pid = int(file.read().split()[0])
+			except (OSError, IndexError, ValueError):
+				return 0.0
+		return processCpuSeconds(self.exec_pid) or 0.0
+
+	def alive(self) -> bool:
+		return self.proc.poll() is None
+
+	def send(self, message: str | bytes) -> bool:
+		data = memoryview(message.encode() if isinstance(message, str) else message)
+		try:
+			while len(data) > 0:
+				data = data[self.proc.stdin.write(data):]
+			return True
+		except (BrokenPipeError, OSError):
+			return False
+
+	def readLine(self, deadline: float, cpu_deadline: float | None = None) -> str | None:
+		"""Return line without new line, "" on EOF, None when the (monotonic) deadline passes
+		or the exec's CPU time reaches cpu_deadline."""
+		while b"\n" not in self.buffer:
+			remaining = deadline - time.monotonic()
+			if remaining <= 0:
+				return None
+			if cpu_deadline is not None:
+				if self.cpuSeconds() >= cpu_deadline:
+					return None
+				remaining = min(remaining, CPU_POLL_S)
+			ready, _, _ = select.select([self.proc.stdout], [], [], remaining)
+			if not ready:
+				continue
+			chunk = os.read(self.proc.stdout.fileno(), 4096)
+			if not chunk:
+				# EOF -- return whatever is left:
+				line, self.buffer = self.buffer, b""
+				return line.decode().strip()
+			self.buffer += chunk
+		line, self.buffer = self.buffer.split(b"\n", 1)
+		return line.decode().strip()
+
+	def kill(self):
+		if self.alive():
+			self.proc.kill()
+		self.proc.wait()
+
+class SandboxLauncher:
+	"""native/sandbox running one exec (once per move) for the whole game, used by the full protocol."""
+
+	def __init__(self, sandbox: str, exec_str: str, memory_mb: int):
+		self.proc = subprocess.Popen([sandbox, "--memory", str(memory_mb), exec_str], stdin = subprocess.PIPE, stdout = subprocess.PIPE, bufsize = 0)
+
+	def readExactly(self, size: int, deadline: float) -> bytes | None:
+		data = b""
+		while len(data) < size:
+			remaining = deadline - time.monotonic()
+			if remaining <= 0:
+				return None
+			ready, _, _ = select.select([self.proc.stdout], [], [], remaining)
+			if not ready:
+				return None
+			chunk = os.read(self.proc.stdout.fileno(), size - len(data))
+			if not chunk:
+				return None
+			data += chunk
+		return data
+
+	def run(self, state: bytes, cpu_limit_ms: int, wall_limit_ms: int) -> tuple[int, int, ExecRun] | None:
+		"""(status, exit code, run) of one run, None if the launcher itself failed."""
+		try:
+			self.proc.stdin.write(struct.pack("<III", len(state), cpu_limit_ms, wall_limit_ms) + state)
+		except (BrokenPipeError, OSError):
+			return None
+		deadline = time.monotonic() + wall_limit_ms / 1000 + SANDBOX_GRACE_S
+		header = self.readExactly(SANDBOX_RESPONSE.size, deadline)
+		if header is None:
+			return None
+		status, code, wall_us, cpu_us, length = SANDBOX_RESPONSE.unpack(header)
+		output = self.readExactly(length, deadline) if length > 0 else b""
+		if output is None:
+			return None
+		violation = {SANDBOX_CPU_LIMIT: "cpu", SANDBOX_WALL_LIMIT: "wall"}.get(status)
+		return status, code, ExecRun(output, code, cpu_us / 1000, wall_us / 1000, violation)
+
+	def kill(self):
+		if self.proc.poll() is None:
+			self.proc.kill()
+		self.proc.wait()
 
 class Game:
-	def __init__(self, n: int, m: int, wall_count: int, red_player_exec: str, blue_player_exec: str, seed = None):
+	def __init__(self, n: int, m: int, wall_count: int, red_player_exec: str, blue_player_exec: str, seed = None, protocol: str = "full", state_format: str = "text", timeout_ms: int = 1000, match_budget_ms: int = 0, sandbox: str | None = None, memory_mb: int = 256, wall_timeout_ms: int = 0, move_cache: MoveCache | None = None):
 		self.game_state   = GameLogic(n, m, wall_count, seed)
 		self.round_number = 0
 
+		self.timeout_ms = timeout_ms
+		# wall time limit of a move, twice the (CPU) time limit by default
+		self.wall_timeout_ms = wall_timeout_ms if wall_timeout_ms > 0 else 2 * timeout_ms
+		self.violations = []
+		self.cpu_ms = {PlayersID.RED: 0.0, PlayersID.BLUE: 0.0}
+		# remaining match budget (CPU time of execs) of each player, None if unlimited
+		self.remaining_ms = None
+		if match_budget_ms > 0:
+			self.remaining_ms = {PlayersID.RED: match_budget_ms, PlayersID.BLUE: match_budget_ms}
+
 		self.red_player_exec  = red_player_exec
 		self.blue_player_exec = blue_player_exec
 
+		assert protocol in PROTOCOLS
+		assert state_format in STATE_FORMATS
+		self.protocol = protocol
+		self.state_format = state_format
+		# only for the delta protocol:
+		self.bot_processes = {}
+		self.last_moves = {}
+		# path of native/sandbox (None runs execs directly) and its launchers for the full protocol:
+		self.sandbox = sandbox
+		self.memory_mb = memory_mb
+		self.launchers = {}
+		# MoveCache of deterministic execs (full protocol only), None if disabled:
+		self.move_cache = move_cache if protocol == "full" else None
+
+	def close(self):
+		for proc in [*self.bot_processes.values(), *self.launchers.values()]:
+			proc.kill()
+		self.bot_processes = {}
+		self.launchers = {}
+
+	def botCommand(self, exec_str: str) -> str | list[str]:
+		"""Command of a long living exec (delta protocol)."""
+		if self.sandbox is None:
+			return exec_str
+		return [self.sandbox, "--persistent", "--memory", str(self.memory_mb), exec_str]
+
+	def startBot(self, exec_str: str) -> BotProcess:
+		return BotProcess(self.botCommand(exec_str), sandboxed = self.sandbox is not None)
+
+	def recordMove(self, exec_str: str, who: PlayersID, cpu_ms: float, wall_ms: float, violation: str | None = None):
+		"""Accounts CPU time of a move, records and reports a violation of its limits."""
+		self.cpu_ms[who] += cpu_ms
+		if violation is not None:
+			self.violations.append(Violation(self.round_number, who, violation, cpu_ms, wall_ms))
+			print(f"Warning: {exec_str} hit {'CPU' if violation == 'cpu' else 'wall'} time limit ({cpu_ms:.0f} ms CPU, {wall_ms:.0f} ms wall) -- waiting.")
+
+	def timeReport(self) -> str:
+		lines = []
+		for who in (PlayersID.RED, PlayersID.BLUE):
+			violations = [v for v in self.violations if v.player == who]
+			cpu = sum(1 for v in violations if v.kind == "cpu")
+			lines.append(f"{showPlayerID(who)}: {self.cpu_ms[who]:.0f} ms CPU, time limit violations: {cpu} CPU, {len(violations) - cpu} wall")
+		return "\n".join(lines)
+
 	def showForUser(self, who: PlayersID | None = None, nice: bool = False) -> str:
 		output = [self.game_state.showForUser(nice = nice)]
 		output.append(str(self.round_number))
@@ -26,6 +313,22 @@ class Game:
 			output.append(showPlayerID(who))
 			output.append("\n")
 		return ''.join(output)
+
+	def moveClock(self, who: PlayersID) -> tuple[int, int]:
+		"""Time limit of the next move of the player and its remaining budget (0 if unlimited)."""
+		if self.remaining_ms is None:
+			return self.timeout_ms, 0
+		remaining = max(self.remaining_ms[who], 0)
+		return min(self.timeout_ms, remaining), remaining
+
+	def stateForUser(self, who: PlayersID) -> str | bytes:
+		"""State sent to exec, in the selected format."""
+		time_limit, remaining = self.moveClock(who)
+		if self.state_format == "binary":
+			header = struct.pack("<4sHHIc3xII", BINARY_MAGIC, self.game_state.n, self.game_state.m,
+			                     self.round_number, showPlayerID(who).encode(), time_limit, remaining)
+			return header + self.game_state.packPlanes()
+		return self.showForUser(who) + f"{time_limit} {remaining}\n"
 	
 	def parseOutput(self, out: str) -> MoveProfile:
 		try:
@@ -41,52 +344,147 @@ class Game:
 			assert False
 
 	
+	def runExecSandboxed(self, exec_str: str, state: bytes, time_limit: int, who: PlayersID) -> ExecRun | None:
+		"""None if the sandbox itself failed."""
+		launcher = self.launchers.get(who)
+		if launcher is None:
+			launcher = SandboxLauncher(self.sandbox, exec_str, self.memory_mb)
+			self.launchers[who] = launcher
+		result = launcher.run(state, time_limit, self.wall_timeout_ms)
+		if result is None:
+			# broken launcher, a new one (and jail) next move
+			launcher.kill()
+			del self.launchers[who]
+			return None
+		status, code, run = result
+		if status not in (SANDBOX_OK, SANDBOX_CPU_LIMIT, SANDBOX_WALL_LIMIT):
+			run.returncode = code or 1
+		return run
+
 	def runExec(self, exec_str: str, who: PlayersID) -> MoveProfile:
-		if RUN_IN_ISOLATE:
-			with open("./isolate_running/in/in", "w") as input_file:
-				input_file.write(self.showForUser(who))
-			with open("./isolate_running/out/user_output", "w") as output_file:
-				output_file.write(str(MoveProfile.WAIT.value) + "\n")
-		
-			shutil.copyfile(exec_str, "./isolate_running/prog/exec")
-
-			# @Fixme: Putting it in the dev null might hide some errors. Beware:
-			run_result = subprocess.run(["bash", "./isolate_running/run.sh"], stdout = subprocess.DEVNULL, stderr=subprocess.DEVNULL)
-			
-			if run_result.returncode != 0:
-				print(f"Rule violation by {exec_str}!!!")
-				assert False
-
-			out = None
-			with open("./isolate_running/out/user_output", "r") as output_file:
-				out = output_file.read()
-
-			assert out is not None
-			
-			return self.parseOutput(out)
+		time_limit, _ = self.moveClock(who)
+		# @TODO: this fails when exec_str in not given explicitly as relative path
+		state = self.stateForUser(who)
+		if isinstance(state, str):
+			state = state.encode()
+
+		memoized = self.move_cache is not None and self.move_cache.memoized(exec_str)
+		cached = self.move_cache.get(exec_str, state) if memoized else None
+		if cached is not None and not self.move_cache.spotCheck():
+			move, cpu_ms = cached
+			self.recordMove(exec_str, who, cpu_ms, 0)
+			return MoveProfile(move)
+
+		started = time.monotonic()
+		if self.sandbox is not None:
+			run = self.runExecSandboxed(exec_str, state, time_limit, who)
 		else:
-			try:
-				# @TODO: this fails when exec_str in not given explicitly as relative path
-				# @TODO: get timeout from config
-				out = subprocess.check_output(exec_str, input = self.showForUser(who), text=True, timeout = 1.0)
-				return self.parseOutput(out)
-			except subprocess.TimeoutExpired:
-				print("Warning: Exec hit timeout")
-				return MoveProfile.WAIT
-			except ValueError:
-				print(f"Warning: {exec_str} returned invalid value -- surrendering.")
-				return MoveProfile.SURRENDER
-			except subprocess.CalledProcessError:
-				print(f"Warning: {exec_str} returned non zero code -- surrendering.")
-				return MoveProfile.SURRENDER
-		
+			run = runTimed(exec_str, state, time_limit, self.wall_timeout_ms)
+		if run is None:
+			print(f"Warning: sandbox of {exec_str} failed -- waiting.")
+			self.recordMove(exec_str, who, 0, (time.monotonic() - started) * 1000)
+			return MoveProfile.WAIT
+
+		self.recordMove(exec_str, who, run.cpu_ms, run.wall_ms, run.violation)
+		if run.violation is not None:
+			return MoveProfile.WAIT
+		if run.returncode != 0:
+			print(f"Warning: {exec_str} returned non zero code ({run.returncode}) -- surrendering.")
+			return MoveProfile.SURRENDER
+		try:
+			move = self.parseOutput(run.output.decode())
+		except UnicodeDecodeError:
+			print(f"Warning: {exec_str} returned invalid value -- surrendering.")
+			move = MoveProfile.SURRENDER
+
+		if cached is not None and cached[0] != move.value:
+			print(f"Warning: {exec_str} is declared deterministic, but answered {move.value} instead of {cached[0]} -- not memoized any more.")
+			self.move_cache.mismatch(exec_str)
+		elif memoized and cached is None:
+			self.move_cache.put(exec_str, state, move.value, run.cpu_ms)
+		return move
+
+	def deltaMessage(self, who: PlayersID) -> str:
+		opponent = PlayersID.BLUE if who == PlayersID.RED else PlayersID.RED
+		time_limit, remaining = self.moveClock(who)
+		return f"{self.round_number} {self.last_moves[opponent].value} {self.game_state.stateChecksum()} {time_limit} {remaining}\n"
+
+	def runExecDelta(self, exec_str: str, who: PlayersID) -> MoveProfile:
+		time_limit, _ = self.moveClock(who)
+		started = time.monotonic()
+		deadline = started + self.wall_timeout_ms / 1000
+		proc = self.bot_processes.get(who)
+		sent_delta = False
+
+		if proc is not None and proc.alive() and who in self.last_moves:
+			cpu_start = proc.cpuSeconds()
+			sent_delta = proc.send(self.deltaMessage(who))
+
+		if not sent_delta:
+			if proc is not None:
+				proc.kill()
+			proc = self.startBot(exec_str)
+			self.bot_processes[who] = proc
+			cpu_start = 0.0
+			proc.send(self.stateForUser(who))
+
+		cpu_deadline = cpu_start + time_limit / 1000
+		out = proc.readLine(deadline, cpu_deadline)
+
+		if out == "" and sent_delta:
+			# exec does not keep running -- start it again with whole state:
+			proc.kill()
+			proc = self.startBot(exec_str)
+			self.bot_processes[who] = proc
+			cpu_start = 0.0
+			cpu_deadline = time_limit / 1000
+			proc.send(self.stateForUser(who))
+			out = proc.readLine(deadline, cpu_deadline)
+
+		if out == "resync":
+			proc.send(self.stateForUser(who))
+			out = proc.readLine(deadline, cpu_deadline)
+
+		cpu = proc.cpuSeconds()
+		cpu_ms = max(cpu - cpu_start, 0) * 1000
+		wall_ms = (time.monotonic() - started) * 1000
+		if out is None or (cpu >= cpu_deadline and proc.alive()):
+			self.recordMove(exec_str, who, cpu_ms, wall_ms, "cpu" if cpu >= cpu_deadline else "wall")
+			# late answer would break the protocol, so we restart it next round
+			proc.kill()
+			del self.bot_processes[who]
+			return MoveProfile.WAIT
+		self.recordMove(exec_str, who, cpu_ms, wall_ms)
+
+		if out == "" and not proc.alive() and proc.proc.returncode != 0:
+			print(f"Warning: {exec_str} returned non zero code -- surrendering.")
+			return MoveProfile.SURRENDER
+
+		return self.parseOutput(out)
+
+	def runPlayer(self, exec_str: str, who: PlayersID) -> MoveProfile:
+		"""Run exec with the selected protocol and charge its CPU time to the match budget."""
+		if self.remaining_ms is not None and self.remaining_ms[who] <= 0:
+			print(f"Warning: {exec_str} used whole match budget -- waiting.")
+			return MoveProfile.WAIT
+
+		cpu_before = self.cpu_ms[who]
+		if self.protocol == "delta":
+			move = self.runExecDelta(exec_str, who)
+		else:
+			move = self.runExec(exec_str, who)
+		if self.remaining_ms is not None:
+			self.remaining_ms[who] -= int(self.cpu_ms[who] - cpu_before)
+		return move
+
 	def performMoveWithExec(self):
 		"""Return list of hits or "tie" string if round limit was hit."""
 
-		red_move  = self.runExec(self.red_player_exec, who = PlayersID.RED)
-		blue_move = self.runExec(self.blue_player_exec, who = PlayersID.BLUE)
+		red_move  = self.runPlayer(self.red_player_exec, who = PlayersID.RED)
+		blue_move = self.runPlayer(self.blue_player_exec, who = PlayersID.BLUE)
 
 		out = self.game_state.applyMove(Move([red_move, blue_move]))
+		self.last_moves = {PlayersID.RED: red_move, PlayersID.BLUE: blue_move}
 		
 		self.round_number += 1
 		
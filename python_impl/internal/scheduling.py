@@ -0,0 +1,124 @@
+# Scheduling and scoring of tournament pairings.
+# Every map seed is played twice with colors swapped (maps are point symmetric, see
+# GameLogic.__init__), so the map and the color advantage cancel out within a pair of games.
+# A pairing is scored by its pairs: points of the first user in both games (0, 0.5, ..., 2).
+# Pairings of a tournament come from round robin (all of them), Swiss system (neighbours
+# by points or rating, O(log n) rounds) or a seeded knockout bracket.
+
+import math
+
+# two-sided 95% quantiles of Student's t distribution, by degrees of freedom:
+_T_95 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+         2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+         2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+
+def meanInterval(samples: list[float]) -> tuple[float, float, float]:
+	"""Mean, sample variance and half width of the 95% confidence interval of the mean."""
+	count = len(samples)
+	if count == 0:
+		return 0.0, 0.0, math.inf
+	mean = sum(samples) / count
+	if count == 1:
+		return mean, 0.0, math.inf
+	variance = sum((x - mean) ** 2 for x in samples) / (count - 1)
+	t = _T_95[count - 2] if count - 2 < len(_T_95) else 1.96
+	return mean, variance, t * math.sqrt(variance / count)
+
+def gamePoints(result: str, red: bool) -> float:
+	"""Points of a player of the game: 1 for a win, 0.5 for a tie."""
+	if result == "TIE":
+		return 0.5
+	return 1.0 if (result == "RED") == red else 0.0
+
+def pairedJobs(pairing: tuple[int, int], execs: tuple[str, str], seeds: list[int], game_args: dict, prefix: str = "") -> list[dict]:
+	"""Two games per seed: first user red, then blue."""
+	i, j = pairing
+	jobs = []
+	for k, seed in enumerate(seeds):
+		for swapped in (False, True):
+			red, blue = (execs[1], execs[0]) if swapped else execs
+			jobs.append({
+				"id": f"{prefix}{i}-{j}-{k}-{int(swapped)}",
+				"pairing": [i, j],
+				"seed_index": k,
+				"swapped": swapped,
+				"red": red,
+				"blue": blue,
+				"args": dict(game_args, seed = seed),
+			})
+	return jobs
+
+class PairingScore:
+	def __init__(self, pairing: tuple[int, int], seed_count: int):
+		self.pairing = pairing
+		self.games_left = 2 * seed_count
+		# seed index -> points of the first user in its games:
+		self.games = {}
+		self.failed_pairs = set()
+
+	def add(self, job: dict, result: str | None):
+		self.games_left -= 1
+		if result is None:
+			# the other game of the pair alone would bring the color advantage back
+			self.failed_pairs.add(job["seed_index"])
+			return
+		self.games.setdefault(job["seed_index"], []).append(gamePoints(result, not job["swapped"]))
+
+	def complete(self) -> bool:
+		return self.games_left == 0
+
+	def pairScores(self) -> list[float]:
+		return [sum(points) for k, points in self.games.items() if len(points) == 2 and k not in self.failed_pairs]
+
+	def summary(self) -> tuple[float, float, float, float, float]:
+		"""Points of both users (of complete pairs), then mean, variance and 95% interval half width
+		of the first user's share of points per game."""
+		scores = self.pairScores()
+		first = sum(scores)
+		mean, variance, half_width = meanInterval([score / 2 for score in scores])
+		return first, 2 * len(scores) - first, mean, variance, half_width
+
+def roundRobinPairings(count: int) -> list[tuple[int, int]]:
+	return [(i, j) for i in range(count) for j in range(i + 1, count)]
+
+def swissPairings(ranking: list[int], played: set[frozenset], byes: dict[int, int]) -> tuple[list[tuple[int, int]], int | None]:
+	"""Pairs neighbours of the ranking (best first), avoiding rematches when possible.
+	With an odd count the lowest ranked of the users with the fewest byes (user -> count) gets one,
+	so nobody gets a second bye before everybody had one. Returns (pairings, bye)."""
+	remaining = list(ranking)
+	bye = None
+	if len(remaining) % 2 == 1:
+		bye = min(reversed(remaining), key = lambda user: byes.get(user, 0))
+		remaining.remove(bye)
+
+	pairings = []
+	while remaining:
+		first = remaining.pop(0)
+		second = next((user for user in remaining if frozenset((first, user)) not in played), remaining[0])
+		remaining.remove(second)
+		pairings.append((first, second))
+	return pairings, bye
+
+def knockoutBracket(count: int) -> list[int | None]:
+	"""Seeds (0 is the best) in bracket order, so that seed k meets seed size - 1 - k first
+	and the top seeds meet as late as possible; None are byes."""
+	bracket = [0]
+	while len(bracket) < count:
+		size = 2 * len(bracket)
+		bracket = [seed for top in bracket for seed in (top, size - 1 - top)]
+	return [seed if seed < count else None for seed in bracket]
+
+class EloRatings:
+	"""Elo ratings updated by the share of points of every match."""
+
+	def __init__(self, count: int, k: float = 32, initial: float = 1500):
+		self.ratings = [initial] * count
+		self.k = k
+
+	def expected(self, i: int, j: int) -> float:
+		return 1 / (1 + 10 ** ((self.ratings[j] - self.ratings[i]) / 400))
+
+	def update(self, i: int, j: int, share: float):
+		delta = self.k * (share - self.expected(i, j))
+		self.ratings[i] += delta
+		self.ratings[j] -= delta
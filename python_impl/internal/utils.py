@@ -1,5 +1,6 @@
 from .runner import *
 from .args import *
+from .move_cache import openMoveCache
 
 import time
 import os
@@ -17,9 +18,29 @@ def runWithArgs(args):
 		args.wall_count,
 		args.red,
 		args.blue,
-		args.seed
+		args.seed,
+		args.protocol,
+		args.state_format,
+		args.timeout,
+		args.match_budget,
+		args.sandbox,
+		args.memory_limit,
+		args.wall_timeout,
+		openMoveCache(args.move_cache, args.spot_check) if args.move_cache else None
 	)
 
+	try:
+		result = runGame(game, args)
+		if not args.silent or game.violations:
+			print(game.timeReport())
+		if not args.silent and game.move_cache is not None:
+			cache = game.move_cache
+			print(f"Memoized moves: {cache.hits} hits, {cache.spot_checks} spot checks, {cache.mismatches} mismatches")
+		return result
+	finally:
+		game.close()
+
+def runGame(game: Game, args):
 	if not args.silent:
 		if args.clear_terminal:
 			clearTerminal()
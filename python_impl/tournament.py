@@ -1,42 +1,34 @@
-# This script might be broken for now. It will be fixed in the future.
-
-from internal.utils import runWithArgs
+# Tournament of user_submits/*.cpp: round robin, Swiss system or seeded knockout.
+# Games are played by workers (worker.py) that pull them from this script (the coordinator)
+# over a socket, see internal/distributed.py. By default workers are started on this host;
+# with --listen tcp:0.0.0.0:PORT workers of other hosts can join with
+# `OFF24_TOKEN=<token> python worker.py --connect tcp:HOST:PORT` (a TCP coordinator
+# prints a random token, unless it is given with --token or OFF24_TOKEN).
 
+import argparse
+import math
 import os
-import time
+import random
+import secrets
+import shlex
 import subprocess
+import tempfile
+import time
 from dataclasses import dataclass
 
-def runWithTournamentDefaults(red, blue):
-	# LOL:
-	args = lambda x:x
-
-	args.red = red
-	args.blue = blue
-	args.round_count = 500
-	args.height = 15
-	args.width = 20
-	args.wall_count = 20
-	args.nice_print = False
-	args.wait = 10
-	args.clear_terminal = False
-	args.seed = None
-	args.silent = False
-
-	return runWithArgs(args)
-
-def grabFiles():
+from internal.args import ExplicitDefaultsHelpFormatter, GAME_ARGUMENTS, addGameArguments
+from internal.build import DEFAULT_FLAGS, buildAll
+from internal.distributed import Coordinator, startLocalWorkers, TOKEN_VARIABLE
+from internal.journal import Journal, tournamentFingerprint
+from internal.result_cache import ResultCache, fileDigest
+from internal.scheduling import EloRatings, PairingScore, knockoutBracket, meanInterval, pairedJobs, roundRobinPairings, swissPairings
+
+def grabFiles(directory: str = "user_submits"):
 	files = []
-	for file in os.listdir("user_submits"):
+	for file in os.listdir(directory):
 		if file.endswith(".cpp"):
-			files.append("user_submits/" + file)
-	return files
-
-def runBash(command):
-	print(f"Running: {command}:")
-	proc = subprocess.Popen(command, stdout=subprocess.PIPE, shell=True)
-	(out, err) = proc.communicate()
-	return out, err
+			files.append(os.path.join(directory, file))
+	return sorted(files)
 
 @dataclass
 class User():
@@ -44,99 +36,282 @@ class User():
 	exec: str
 	score: int
 
-def getUsers(solutions, compile = True):
-	users = []
-	for solution in solutions:
-		name = solution[:-4]
-		output = f"{name}.exe"
-		users.append(User(name, output, 0))
-		
-		if compile:
-			compiler_out = runBash(f"g++ -O3 -static -std=c++20 {solution} -o {output}")
-			print(compiler_out)
-		
-	return users
+def getUsers(solutions, compile = True, flags: list[str] = DEFAULT_FLAGS, build_cache: str | None = ".build_cache", jobs: int | None = None):
+	"""Users of submissions, compiled in parallel (unchanged ones come from the build cache).
+	Submissions that don't compile are left out."""
+	users = [User(solution[:-4], f"{solution[:-4]}.exe", 0) for solution in solutions]
+	if not compile:
+		for user in users:
+			if not os.path.exists(user.exec):
+				print(f"Warning: {user.exec} does not exist -- {user.name} is left out.")
+		return [user for user in users if os.path.exists(user.exec)]
 
+	started = time.monotonic()
+	results = buildAll(solutions, [user.exec for user in users], flags, build_cache, jobs)
+	print(f"Build stage: {time.monotonic() - started:.2f} s", flush = True)
+	return [user for user, result in zip(users, results) if result.ok]
 
-def main():
-	solutions = grabFiles()
-	users = getUsers(solutions, compile=False)
-
-	round_count = 3
-
-	for i in range(len(users)):
-		for j in range(i+1, len(users)):
-			score_b = 0
-			score_r = 0
-			
-			os.system("clear")
-			print("Now playing....!", flush=True)
-			time.sleep(1)
-			print(users[i].name, end = "", flush=True)
-			time.sleep(2)
-			print("    VS    ", end="", flush=True)
-			time.sleep(3)
-			print(users[j].name, end="", flush=True)
-			time.sleep(4)
-			print("\nFIGHT!!!!", flush=True)
-			time.sleep(2)
-			
-			for round in range(round_count):
-				os.system("clear")
-				print(f"Round {round}!", flush=True)
-				time.sleep(1)
+def getTournamentArgParser() -> argparse.ArgumentParser:
+	arg_parser = argparse.ArgumentParser(
+		prog='off_tournament',
+		description='Tournament of submissions, played by local or remote workers.',
+		formatter_class = ExplicitDefaultsHelpFormatter
+	)
+	arg_parser.add_argument('--submits', type=str, default="user_submits", help='Directory with submitted .cpp files.')
+	arg_parser.add_argument('--no-compile', action='store_true', help='Use existing .exe files instead of building submissions.')
+	arg_parser.add_argument('--cxxflags', type=str, default=" ".join(DEFAULT_FLAGS), help='Compiler flags of submissions.')
+	arg_parser.add_argument('--build-cache', type=str, default=".build_cache", help='Directory of cached binaries (by source, local headers, flags and compiler), "" disables it.')
+	arg_parser.add_argument('--build-jobs', type=int, default=os.cpu_count(), help='Compilers run at once.')
+	arg_parser.add_argument('--format', choices=['round-robin', 'swiss', 'knockout'], default='round-robin', help='Round robin plays all pairings, Swiss and knockout need O(n log n) matches.')
+	arg_parser.add_argument('--rounds', type=int, help='Swiss rounds (ceil(log2(users)) + 2, at most users - 1, if not given).')
+	arg_parser.add_argument('--pairing', choices=['score', 'rating'], default='score', help='Swiss pairing by match points or by Elo rating.')
+	arg_parser.add_argument('--seeding', type=str, help='Knockout seeding: file with user names (e.g. a previous ranking), best first; others follow by name.')
+	arg_parser.add_argument('--seeds', type=int, default=2, help='Maps of every pairing, each is played twice with colors swapped.')
+	arg_parser.add_argument('--seed', type=int, default=0, help='Seed of the map seeds; map k of every pairing is the same, so results stay cacheable.')
+	arg_parser.add_argument('--cache', type=str, default=".tournament_cache", help='Directory of cached game results (by binaries, map and options), "" disables it.')
+	arg_parser.add_argument('--journal', type=str, default="tournament.journal", help='Journal of finished games; a restarted tournament (the same one) resumes from it, a completed one removes it, "" disables it.')
+	arg_parser.add_argument('--fresh', action='store_true', help='Discard the journal and start the tournament over.')
+	arg_parser.add_argument('--listen', type=str, help='Coordinator address: tcp:HOST:PORT or unix:PATH (a temporary UNIX socket if not given).')
+	arg_parser.add_argument('--token', type=str, help=f'Token workers must present (default: ${TOKEN_VARIABLE}, a random one for a TCP address).')
+	arg_parser.add_argument('--local-workers', type=int, default=os.cpu_count(), help='Workers started on this host.')
+	arg_parser.add_argument('--lease', type=float, default=60, help='Seconds without heartbeat after which a game of a silent worker is given to another one.')
+	addGameArguments(arg_parser, timeout=1000, height=15, width=20, wall_count=20, round_count=500, move_cache='.move_cache.sqlite')
+	return arg_parser
 
-				try:
-					out = runWithTournamentDefaults(users[i].exec, users[j].exec)
-				except:
-					print("Ow no...")
-					exit(1)
-				
-				if out == "TIE":
-					print("TIE!!!")
-					score_b += 0.5
-					score_r += 0.5
-				if out == "RED":
-					print("RED WON!!!")
-					score_r += 1
-				if out == "BLUE":
-					print("BLUE WON!!!")
-					score_b += 1
-				
-				time.sleep(1)
-
-				print(f"Result of the round: ")
-				print(f"   Blue: {score_b}")
-				print(f"   Red:  {score_r}")
-
-				time.sleep(5)
-
-			# red i
-			# blue j
-
-			if score_b > score_r:
-				print("")
-				print("Round result: Blue won!!!")
-				users[j].score += 1
-			elif score_r > score_b:
-				print("")
-				print("Round result: Red won!!!")
-				users[i].score += 1
+def playJobs(coordinator: Coordinator, jobs: list[dict], cache: ResultCache | None = None, journal: Journal | None = None):
+	"""Yields (job, result) as workers finish them, result is None if the game kept failing.
+	Games in the journal (of an interrupted run) or in the cache are not played again."""
+	to_play = []
+	journaled = cached = 0
+	for job in jobs:
+		result = journal.lookup(job) if journal is not None else None
+		if result is not None:
+			journaled += 1
+			yield job, result
+			continue
+		result = cache.get(job) if cache is not None else None
+		if result is None:
+			to_play.append(job)
+			continue
+		cached += 1
+		if journal is not None:
+			journal.append(job, result)
+		yield job, result
+	if journaled + cached > 0:
+		print(f"{len(jobs)} games: {journaled} from the journal, {cached} cached, {len(to_play)} to play.", flush=True)
+
+	coordinator.submit(to_play)
+	for job, result, error in coordinator.results():
+		if result is not None:
+			if cache is not None:
+				cache.put(job, result)
+			if journal is not None:
+				journal.append(job, result)
+		yield job, result
+
+class Tournament:
+	"""Plays matches (paired games of two users) and keeps points, Elo ratings and shares of points."""
+
+	def __init__(self, users: list[User], coordinator: Coordinator, cache: ResultCache | None, journal: Journal | None, seeds: list[int], game_args: dict):
+		self.users = users
+		self.coordinator = coordinator
+		self.cache = cache
+		self.journal = journal
+		self.seeds = seeds
+		self.game_args = game_args
+		self.elo = EloRatings(len(users))
+		# share of points per game of every user, by pairs of games (so map and colors cancel out):
+		self.shares = [[] for _ in users]
+		self.played = set()
+
+	def playMatches(self, matches: list[tuple[int, int]], prefix: str = "", seeds: list[int] | dict[tuple[int, int], list[int]] | None = None) -> dict[tuple[int, int], PairingScore]:
+		"""Plays all matches at once and scores them: winner gets 1 point, a tie 0.5.
+		Elo ratings are updated once all are played, in the order of `matches` (not the order
+		the games finish in), so a resumed tournament rates and pairs the same way.
+		Seeds may be given per match (a dict by pairing)."""
+		seeds = self.seeds if seeds is None else seeds
+		jobs = []
+		scores = {}
+		means = {}
+		for i, j in matches:
+			match_seeds = seeds[(i, j)] if isinstance(seeds, dict) else seeds
+			jobs += pairedJobs((i, j), (self.users[i].exec, self.users[j].exec), match_seeds, self.game_args, prefix)
+			scores[(i, j)] = PairingScore((i, j), len(match_seeds))
+
+		for job, result in playJobs(self.coordinator, jobs, self.cache, self.journal):
+			score = scores[tuple(job["pairing"])]
+			i, j = score.pairing
+			if result is None:
+				print(f"Game {job['id']} ({self.users[i].name} vs {self.users[j].name}) failed -- its pair is not counted.")
+			score.add(job, result)
+			if not score.complete():
+				continue
+
+			self.played.add(frozenset((i, j)))
+			pairs = score.pairScores()
+			if not pairs:
+				print(f"{self.users[i].name} vs {self.users[j].name}: no complete pair of games -- no points.")
+				continue
+			printPairing(self.users, score)
+			first, second, mean, _, _ = score.summary()
+			if second > first:
+				self.users[j].score += 1
+			elif first > second:
+				self.users[i].score += 1
+			else:
+				self.users[i].score += 0.5
+				self.users[j].score += 0.5
+			means[(i, j)] = mean
+			for pair in pairs:
+				self.shares[i].append(pair / 2)
+				self.shares[j].append(1 - pair / 2)
+		for i, j in matches:
+			if (i, j) in means:
+				self.elo.update(i, j, means[(i, j)])
+		return scores
+
+	def roundRobin(self) -> list[int]:
+		self.playMatches(roundRobinPairings(len(self.users)))
+		return sorted(range(len(self.users)), key = lambda k: (-self.users[k].score, -self.elo.ratings[k]))
+
+	def buchholz(self, user: int) -> float:
+		"""Sum of points of the opponents (Swiss tie break)."""
+		return sum(self.users[other].score for pair in self.played if user in pair for other in pair if other != user)
+
+	def swiss(self, rounds: int, pairing: str) -> list[int]:
+		byes = {}
+		for round in range(rounds):
+			if pairing == "rating":
+				ranking = sorted(range(len(self.users)), key = lambda k: -self.elo.ratings[k])
 			else:
-				print("")
-				print("Round result: TIE!!!")
-				users[i].score += 0.5
-				users[j].score += 0.5
+				ranking = sorted(range(len(self.users)), key = lambda k: (-self.users[k].score, -self.elo.ratings[k]))
+			matches, bye = swissPairings(ranking, self.played, byes)
+			print(f"Swiss round {round + 1} of {rounds}: {len(matches)} matches.", flush = True)
+			if bye is not None:
+				print(f"{self.users[bye].name} gets a bye.")
+				self.users[bye].score += 1
+				byes[bye] = byes.get(bye, 0) + 1
+			self.playMatches(matches, prefix = f"s{round}-")
+		return sorted(range(len(self.users)), key = lambda k: (-self.users[k].score, -self.buchholz(k), -self.elo.ratings[k]))
+
+	def knockout(self, seeding: list[int], tiebreaks: int = 2) -> list[int]:
+		"""Seeding: users, best first. A tied match gets up to `tiebreaks` more pairs of games
+		(on new maps), then the better seed goes through. Ranking is by the round reached, then by seed."""
+		seed_of = {user: k for k, user in enumerate(seeding)}
+		alive = [seeding[seed] if seed is not None else None for seed in knockoutBracket(len(seeding))]
+		reached = {user: 0 for user in seeding}
+		round = 0
+		while len(alive) > 1:
+			round += 1
+			# bracket slot of every match:
+			slots = {(alive[k], alive[k + 1]): k // 2 for k in range(0, len(alive), 2) if alive[k] is not None and alive[k + 1] is not None}
+			matches = list(slots)
+			print(f"Knockout round {round}: {len(matches)} matches.", flush = True)
+			scores = self.playMatches(matches, prefix = f"k{round}-")
+			totals = {pairing: score.summary()[:2] for pairing, score in scores.items()}
+			for extra in range(tiebreaks):
+				tied = [pairing for pairing in matches if totals[pairing][0] == totals[pairing][1]]
+				if not tied:
+					break
+				# all tie breaks of the round at once, one pair of games each, on a map of its own
+				# (by round, slot and attempt, so cacheable):
+				seeds = {pairing: [random.Random(f"tiebreak-{self.seeds}-{round}-{slots[pairing]}-{extra}").getrandbits(32)] for pairing in tied}
+				for pairing, score in self.playMatches(tied, prefix = f"k{round}-t{extra}-", seeds = seeds).items():
+					first, second, _, _, _ = score.summary()
+					totals[pairing] = (totals[pairing][0] + first, totals[pairing][1] + second)
+			winners = {}
+			for (i, j), (first, second) in totals.items():
+				if first != second:
+					winners[(i, j)] = i if first > second else j
+				else:
+					winners[(i, j)] = i if seed_of[i] < seed_of[j] else j
 
-			time.sleep(1)
+			next_alive = []
+			for k in range(0, len(alive), 2):
+				i, j = alive[k], alive[k + 1]
+				winner = winners[(i, j)] if i is not None and j is not None else (i if i is not None else j)
+				if winner is not None:
+					reached[winner] = round
+				next_alive.append(winner)
+			alive = next_alive
+		return sorted(seeding, key = lambda k: (-reached[k], seed_of[k]))
 
-			print("Scoreboard: ")
-			for u in users:
-				print(f"{u.name:30}{u.score:>30}")
+def readSeeding(users: list[User], path: str | None) -> list[int]:
+	order = sorted(range(len(users)), key = lambda k: users[k].name)
+	if path is None:
+		return order
+	with open(path) as file:
+		names = [line.split()[0] for line in file if line.strip()]
+	rank = {name: k for k, name in enumerate(names)}
+	return sorted(order, key = lambda k: rank.get(users[k].name, len(names)))
 
-			time.sleep(6)
-				
+def printPairing(users: list[User], score: PairingScore):
+	i, j = score.pairing
+	first, second, mean, variance, half_width = score.summary()
+	print(f"{users[i].name} vs {users[j].name}: {first:g} - {second:g}, "
+	      f"share {mean:.3f} +- {half_width:.3f} (95%, pair variance {variance:.3f})", flush = True)
+
+def main():
+	args = getTournamentArgParser().parse_args()
+	users = getUsers(grabFiles(args.submits), compile=not args.no_compile, flags=shlex.split(args.cxxflags),
+	                 build_cache=args.build_cache or None, jobs=args.build_jobs)
+	game_args = {name: getattr(args, name) for name in GAME_ARGUMENTS}
+	rng = random.Random(args.seed)
+	seeds = [rng.getrandbits(32) for _ in range(args.seeds)]
+	cache = ResultCache(args.cache) if args.cache else None
+	journal = None
+	if args.journal:
+		# everything the schedule depends on (results of games are checked per game):
+		fingerprint = tournamentFingerprint({
+			"format": args.format, "rounds": args.rounds, "pairing": args.pairing,
+			"seeding": fileDigest(args.seeding) if args.seeding else None,
+			"seeds": seeds, "users": [user.name for user in users], "args": game_args,
+		})
+		journal = Journal(args.journal, fingerprint, fresh=args.fresh)
+		if journal.set_aside is not None:
+			print(f"{args.journal} is a journal of another tournament -- moved to {journal.set_aside}.", flush=True)
+		if journal.resumed > 0:
+			print(f"Resuming from {args.journal} ({journal.resumed} finished games).", flush=True)
+
+	with tempfile.TemporaryDirectory() as directory:
+		address = args.listen or f"unix:{os.path.join(directory, 'coordinator.sock')}"
+		given_token = args.token or os.environ.get(TOKEN_VARIABLE)
+		token = given_token
+		if token is None and address.startswith("tcp:"):
+			token = secrets.token_hex(16)
+		coordinator = Coordinator(address, lease_seconds=args.lease, token=token)
+		print(f"Coordinator listens on {coordinator.address}, {len(users)} users.", flush=True)
+		if token is not None and given_token is None:
+			print(f"Workers of other hosts need {TOKEN_VARIABLE}={token}.", flush=True)
+		workers = startLocalWorkers(coordinator.address, args.local_workers, token)
+		tournament = Tournament(users, coordinator, cache, journal, seeds, game_args)
+
+		try:
+			if args.format == "swiss":
+				# more rounds than users - 1 can only be rematches:
+				rounds = args.rounds or min(math.ceil(math.log2(max(len(users), 2))) + 2, max(len(users) - 1, 1))
+				ranking = tournament.swiss(rounds, args.pairing)
+			elif args.format == "knockout":
+				ranking = tournament.knockout(readSeeding(users, args.seeding))
+			else:
+				ranking = tournament.roundRobin()
+		finally:
+			coordinator.close()
+			for worker in workers:
+				try:
+					worker.wait(timeout = 10)
+				except subprocess.TimeoutExpired:
+					worker.kill()
+			coordinator.shutdown()
+			if journal is not None:
+				journal.close()
+	if journal is not None:
+		journal.remove()
 
+	print("Scoreboard: ")
+	for k in ranking:
+		mean, _, half_width = meanInterval(tournament.shares[k])
+		print(f"{users[k].name:30}{users[k].score:>10}    elo {tournament.elo.ratings[k]:7.1f}    share {mean:.3f} +- {half_width:.3f}")
 
 if __name__ == "__main__":
 	main()
@@ -0,0 +1,26 @@
+# Tournament worker: pulls games from a coordinator (see tournament.py) and plays them here.
+# Exec paths of jobs are resolved on this host, so run it from a checkout with the same layout.
+
+import argparse
+import os
+
+from internal.distributed import runWorker, startLocalWorkers, TOKEN_VARIABLE
+
+def main():
+	arg_parser = argparse.ArgumentParser(prog="Tournament worker")
+	arg_parser.add_argument('-c', '--connect', type=str, required=True, help='Coordinator address: tcp:HOST:PORT or unix:PATH.')
+	arg_parser.add_argument('-p', '--processes', type=int, default=1, help='Worker processes (games played at once) on this host.')
+	arg_parser.add_argument('--token', type=str, default=os.environ.get(TOKEN_VARIABLE), help=f'Token of the coordinator (default: ${TOKEN_VARIABLE}).')
+	arg_parser.add_argument('--retry', type=float, default=30, help='Seconds to keep reconnecting to a missing coordinator.')
+	args = arg_parser.parse_args()
+
+	if args.processes > 1:
+		for proc in startLocalWorkers(args.connect, args.processes, args.token):
+			proc.wait()
+		return
+
+	played = runWorker(args.connect, args.retry, args.token)
+	print(f"Worker: played {played} games.")
+
+if __name__ == "__main__":
+	main()
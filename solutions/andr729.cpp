@@ -3,18 +3,18 @@
 #include <vector>
 #include <array>
 #include <optional>
-#include <bitset>
+
+#include "common/game.hpp"
+#include "common/large_map.hpp"
+#include "common/protocol.hpp"
+#include "common/time_manager.hpp"
+
+// depth comes from the clock of the input only (see conf::AB_DEPTH_MIN_US)
+OFF_DETERMINISTIC_BOT;
 
 namespace {
 
-#define CONST_NM 1
-#define BIT_SET 1
-#define MOVE_BULLETS_VECTOR 1
-#define NO_BOUND_CHECKS 1
 #define NO_OTHER_CHECKS 1
-#define UNSAFE_OTHERS 1
-#define ALLOW_BIGGER_NM 1
-#define STATIC_WALLS 1
 
 using u64 = uint64_t;
 using i64 = int64_t;
@@ -23,8 +23,18 @@ using i32 = int32_t;
 namespace conf {
 	// note: we want to optimize it so we have 12/3 here
 	constexpr u64 MAX_ROUND_LOOKUP = 8;
+	// used when the referee does not send its clock
 	constexpr u64 AB_DEPTH = 3;
 
+	// depth is chosen from the allotted time only (no clock checks in the search),
+	// so moves stay deterministic; AB_DEPTH_MIN_US[d] is the minimal time for depth d + 1,
+	// i.e. its worst measured time with some slack.
+	// @note: measured on example_ins and random 15x20 / 20x30 states:
+	// depth 3 takes up to ~27ms, depth 4 up to ~230ms, depth 5 up to ~1.6s
+	constexpr u64 MAX_AB_DEPTH = 5;
+	constexpr u64 AB_DEPTH_MIN_US[MAX_AB_DEPTH] = {0, 15'000, 40'000, 300'000, 2'000'000};
+	constexpr u64 DEFAULT_TIME_US = 400'000;
+
 	// round vs ghost count
 	constexpr double ROUND_COEFF = 1024.0;
 
@@ -41,20 +51,14 @@ namespace conf {
 /*******************/
 // Global parameters:
 
-#if CONST_NM == 1
-	constexpr u64 n = 15;
-	constexpr u64 m = 20;
-	constexpr u64 nm = n * m;
-#else
-	static u64 n;
-	static u64 m;
-	static u64 nm;
-#endif
+// board sizes the search is compiled for, the smallest one that fits the input is used
+// (cost of a state grows with the compiled size, not the actual one):
+constexpr u64 SMALL_N = 15;
+constexpr u64 SMALL_M = 20;
 
 constexpr u64 MAX_ROUND = 400;
 static u64 round_number;
-
-constinit bool global_params_set = false;
+static u64 ab_depth = conf::AB_DEPTH;
 
 /*******************/
 
@@ -74,79 +78,6 @@ enum class Move {
 	WAIT        = 8,
 };
 
-enum class Direction {
-	UP    = 0,
-	DOWN  = 1,
-	LEFT  = 2,
-	RIGHT = 3,
-};
-
-constexpr i64 moveIndexPos(i64 index, Direction dir) {
-	switch (dir) {
-		case Direction::UP:
-			return index - m;
-		case Direction::DOWN:
-			return index + m;
-		case Direction::LEFT:
-			return index - 1;
-		case Direction::RIGHT:
-			return index + 1;
-	}
-	assert(false);
-}
-
-[[gnu::cold]]
-constexpr char dirToChar(Direction dir) {
-	switch (dir) {
-		case Direction::UP:
-			return '^';
-		case Direction::DOWN:
-			return 'v';
-		case Direction::LEFT:
-			return '<';
-		case Direction::RIGHT:
-			return '>';
-		default:
-			assert(false);
-	}
-}
-
-constexpr std::array<Direction, 4> DIRECTION_ARRAY = {
-	Direction::UP,
-	Direction::DOWN,
-	Direction::LEFT,
-	Direction::RIGHT
-};
-
-constexpr Direction moveToDir(Move move) {
-	#if UNSAFE_OTHERS == 1
-		return static_cast<Direction>(
-			static_cast<std::underlying_type_t<Move>>(move) % 4
-		);
-	#else
-	switch (move) {
-		case Move::GO_UP:
-			return Direction::UP;
-		case Move::GO_DOWN:
-			return Direction::DOWN;
-		case Move::GO_LEFT:
-			return Direction::LEFT;
-		case Move::GO_RIGHT:
-			return Direction::RIGHT;
-		case Move::SHOOT_UP:
-			return Direction::UP;
-		case Move::SHOOT_DOWN:
-			return Direction::DOWN;
-		case Move::SHOOT_LEFT:
-			return Direction::LEFT;
-		case Move::SHOOT_RIGHT:
-			return Direction::RIGHT;
-		default:
-			assert(false);
-	}
-	#endif
-}
-
 // @OPT: change the order maybe?
 // @note: can't just do it now
 constexpr std::array<Move, 9> MOVE_ARRAY = {
@@ -170,386 +101,6 @@ enum class Player {
 	ENEMY = 1,
 };
 
-constexpr u64 playerToIndex(Player player) {
-	return static_cast<std::underlying_type_t<Player>>(player);
-}
-
-// @TODO: refactor: IdxVec
-struct Vec {
-	i64 x = 0;
-	i64 y = 0;
-
-	constexpr Vec() = default;
-	constexpr Vec(i64 x, i64 y): x(x), y(y) {}
-	// constexpr Vec(const Vec& other) = default;
-	// // constexpr Vec(Vec&& other) = default;
-
-	// constexpr Vec& operator=(const Vec& other) = default;
-	
-	constexpr bool operator==(const Vec& other) const = default;
-
-	constexpr Vec operator+(const Vec& other) const {
-		return {x + other.x, y + other.y};
-	}
-
-	constexpr Vec operator+=(const Vec& other) {
-		x += other.x;
-		y += other.y;
-		return *this;
-	}
-};
-
-constexpr i64 posToIndex(Vec pos) {
-	return pos.x * m + pos.y;
-}
-
-constexpr Vec dirToVec(Direction dir) {
-	// we have our dimension switched
-	// so x is i, y is j
-	// for this reason here
-	// Also x is inverted so we can print it from 0 to n-1 (not reversed)
-
-	// @note: using array is here not faster
-	switch (dir) {
-		case Direction::UP:
-			return {-1, 0};
-		case Direction::DOWN:
-			return {1, 0};
-		case Direction::LEFT:
-			return {0, -1};
-		case Direction::RIGHT:
-			return {0, 1};
-	}
-	assert(false);
-}
-
-constexpr std::array<Vec, 4> DIR_VEC_ARRAY = {
-	dirToVec(Direction::UP),
-	dirToVec(Direction::DOWN),
-	dirToVec(Direction::LEFT),
-	dirToVec(Direction::RIGHT)
-};
-
-constexpr Direction flip(Direction dir) {
-	#if UNSAFE_OTHERS == 1
-		// 0->1, 1->0, 2->3, 3->2
-		auto dir_int = static_cast<std::underlying_type_t<Direction>>(dir);
-		dir_int ^= 0b1;
-		return static_cast<Direction>(dir_int);
-	#else
-	switch (dir) {
-		case Direction::UP:
-			return Direction::DOWN;
-		case Direction::DOWN:
-			return Direction::UP;
-		case Direction::LEFT:
-			return Direction::RIGHT;
-		case Direction::RIGHT:
-			return Direction::LEFT;
-	}
-	assert(false);
-	#endif
-}
-
-template <typename T>
-struct QuadDirStorage {
-	T vals[4];
-
-	QuadDirStorage() = default;
-
-	QuadDirStorage(T up, T down, T left, T right):
-		vals{up, down, left, right} {}
-	
-	QuadDirStorage(const QuadDirStorage& other) = default;
-	QuadDirStorage(QuadDirStorage&& other)      = default;
-
-	QuadDirStorage& operator=(const QuadDirStorage& other) = default;
-	QuadDirStorage& operator=(QuadDirStorage&& other)      = default;
-
-	// eh... C++ boilerplate
-
-	T& up() {
-		return vals[0];
-	}
-	const T& up() const {
-		return vals[0];
-	}
-	
-	T& down() {
-		return vals[1];
-	}
-	const T& down() const {
-		return vals[1];
-	}
-
-	T& left() {
-		return vals[2];
-	}
-	const T& left() const {
-		return vals[2];
-	}
-
-	T& right() {
-		return vals[3];
-	}
-	const T& right() const {
-		return vals[3];
-	}
-
-	T& get(Direction dir) {
-		switch (dir) {
-			case Direction::UP:
-				return up();
-			case Direction::DOWN:
-				return down();
-			case Direction::LEFT:
-				return left();
-			case Direction::RIGHT:
-				return right();
-		}
-		assert(false);
-	}
-
-	const T& get(Direction dir) const{
-		switch (dir) {
-			case Direction::UP:
-				return up();
-			case Direction::DOWN:
-				return down();
-			case Direction::LEFT:
-				return left();
-			case Direction::RIGHT:
-				return right();
-		}
-		assert(false);
-	}
-};
-
-[[gnu::cold]]
-void skipNewLine() {
-	char c;
-	std::cin >> std::noskipws >> c;
-	assert(c == '\n');
-}
-
-// cause std...
-struct Bool {
-	bool b;
-};
-
-struct BoolLayer {
-private:
-	#if BIT_SET == 1
-		using DataT = std::bitset<nm>;
-		std::bitset<nm> bullets;
-	#else
-		using DataT = std::vector<Bool>;
-		std::vector<Bool> bullets{nm, {false}};
-	#endif
-
-	BoolLayer(DataT bullets): bullets(bullets) {}
-
-public:
-	#if BIT_SET == 1
-		bool atIndex(u64 index) const {
-			#if NO_BOUND_CHECKS == 1
-				return this->bullets[index];
-			#else 
-				return this->bullets.test(index);
-			#endif
-		}
-		auto atIndexMut(u64 index) {
-			#if NO_BOUND_CHECKS == 1
-				return this->bullets[index];
-			#else 
-				return this->bullets[index];
-			#endif
-		}
-
-		const auto& getBitset() const {
-			return this->bullets;
-		}
-		auto& getBitsetMut() {
-			return this->bullets;
-		}
-	#else
-		bool atIndex(u64 index) const {
-			#if NO_BOUND_CHECKS == 1
-				return this->bullets[index].b;
-			#else 
-				return this->bullets.at(index).b;
-			#endif
-		}
-
-		bool& atIndexMut(u64 index) {
-			#if NO_BOUND_CHECKS == 1
-				return this->bullets[index].b;
-			#else 
-				return this->bullets.at(index).b;
-			#endif
-		}
-	#endif
-
-	BoolLayer() = default;
-
-
-	BoolLayer(const BoolLayer& other) = default;
-	BoolLayer(BoolLayer&& other)      = default;
-
-	BoolLayer& operator=(const BoolLayer& other) = default;
-	BoolLayer& operator=(BoolLayer&& other)      = default;
-
-	bool get(Vec pos) const {
-		return atIndex(posToIndex(pos));
-	}
-
-	void set(Vec pos, bool val) {
-		atIndexMut(posToIndex(pos)) = val;
-	}
-
-	void andAt(Vec pos, bool v) {
-		bool curr = atIndex(posToIndex(pos));
-		atIndexMut(posToIndex(pos)) = curr and v;
-	}
-
-	static BoolLayer fromVec(const std::vector<Vec>& vecs) {
-		BoolLayer res;
-		for (auto vec: vecs) {
-			res.set(vec, true);
-		}
-		return res;
-	}
-
-	BoolLayer negated() const {
-		#if BIT_SET == 1
-			return BoolLayer(~this->getBitset());
-		#else
-			BoolLayer res;
-			for (i64 i = 0; i < i64(nm); i++) {
-				res.atIndexMut(i) = not this->atIndex(i);
-			}
-			return res;
-		#endif
-	}
-};
-
-struct BulletLayer {
-private:
-	// @opt: reversing the "storage dims" here might be faster
-	QuadDirStorage<BoolLayer> bullets;
-
-public:
-	BulletLayer() = default;
-	
-	BulletLayer(QuadDirStorage<BoolLayer> bullets): bullets(std::move(bullets)) {}
-
-	BulletLayer(const BulletLayer& other) = default;
-	BulletLayer(BulletLayer&& other)      = default;
-	
-	BulletLayer& operator=(const BulletLayer& other) = default;
-	BulletLayer& operator=(BulletLayer&& other) = default;
-
-	const BoolLayer& getBullets(Direction dir) const {
-		return bullets.get(dir);
-	}
-
-	BoolLayer& getBulletsMut(Direction dir) {
-		return bullets.get(dir);
-	}
-
-	void addBulletAtIndex(i64 pos, Direction dir) {
-		bullets.get(dir).atIndexMut(pos) = true;
-	}
-
-	#if BIT_SET == 0
-		void addBulletAtIndexIf(i64 pos, Direction dir, bool if_) {
-			bullets.get(dir).atIndexMut(pos) |= if_;
-		}
-	#endif
-
-	bool isBulletAtIndex(i64 pos) const {
-		bool res = false;
-		for (auto dir: DIRECTION_ARRAY) {
-			res |= bullets.get(dir).atIndex(pos);
-		}
-		return res;
-	}
-
-	/**
-	 * @note For debug print purposes
-	 */
-	[[gnu::cold]]
-	Direction oneDirAt(Vec pos) const {
-		for (auto dir: DIRECTION_ARRAY) {
-			if (bullets.get(dir).get(pos)) {
-				return dir;
-			}
-		}
-		assert(false);
-	}
-
-	void moveBulletsWithWalls(const BoolLayer& walls) {
-		#if (BIT_SET == 1) and (MOVE_BULLETS_VECTOR == 1)
-			// @TODO: -m/+m/-1/+1 are duplicated here:
-			constexpr static std::array<std::pair<Direction, i64>, 4> DIR_SHIFT_ARR = {
-				std::pair{Direction::UP, -i64(m)},
-				{Direction::DOWN, m},
-				{Direction::LEFT, -1},
-				{Direction::RIGHT, 1}	
-			};
-			
-			// @note: shifts here are reversed
-			this->getBulletsMut(Direction::UP).getBitsetMut() >>= m;
-			this->getBulletsMut(Direction::DOWN).getBitsetMut() <<= m;
-			this->getBulletsMut(Direction::LEFT).getBitsetMut() >>= 1;
-			this->getBulletsMut(Direction::RIGHT).getBitsetMut() <<= 1;
-			
-			// flip them:	
-			for (i64 i = 0; i < i64(nm); i++) {
-				for (auto [dir, shift]: DIR_SHIFT_ARR) {
-					// here we don't care about double flips, cause
-					// flipped bullets will only be, where there are no walls!
-					
-					if (walls.atIndex(i) and bullets.get(dir).atIndex(i)) [[unlikely]] {
-						bullets.get(dir).atIndexMut(i) = false;
-						bullets.get(flip(dir)).atIndexMut(i - shift) = true;
-					}
-				}
-			}
-
-			// no assign, we do it inp place
-
-		#else
-			// ideally we want to do it inplace for performance..
-			// for now we ignore it
-			BulletLayer new_bullets;
-
-			for (u64 i = 0; i < nm; i++) {
-				for (auto dir: DIRECTION_ARRAY) {
-					if (bullets.get(dir).atIndex(i)) {
-						i64 new_pos = moveIndexPos(i, dir);
-						Direction new_dir = dir;
-
-						// @note: for now we don't check for out of bounds here.
-						// it should never happen for valid inputs.
-
-						// @opt: this if might be eliminatable
-						if (walls.atIndex(new_pos)) [[unlikely]] {
-							new_dir = flip(dir);
-							new_pos = i;
-						}
-
-						new_bullets.addBulletAtIndex(new_pos, new_dir);
-					}
-				}
-			}
-
-			*this = std::move(new_bullets);
-		#endif
-	}
-};
-
-
 struct SurvivalData {
 	// @note: using i32 here seams be faster
 	// (probably due to lower stack usage)
@@ -751,347 +302,114 @@ public:
 	}
 };
 
-struct PlayerPositions {
-private:
-	Vec player_positions[2];
-public:
-	PlayerPositions() = default;
-	PlayerPositions(Vec hero, Vec enemy): player_positions{hero, enemy} {}
-
-	Vec getPosition(Player player) const {
-		return player_positions[playerToIndex(player)];
-	}
-
-	Vec& getPosition(Player player) {
-		return player_positions[playerToIndex(player)];
-	}
-
-	Vec getHeroPosition() const {
-		return player_positions[playerToIndex(Player::HERO)];
-	}
-
-	Vec getEnemyPosition() const {
-		return player_positions[playerToIndex(Player::ENEMY)];
-	}
-
-};
-
-struct DebugPrintLayer {
-private:
-	std::vector<std::vector<char>> data;
-public:
-	
-	[[gnu::cold]]
-	DebugPrintLayer(): data(n, std::vector<char>(m, ' ')) {}
-
-	[[gnu::cold]]
-	void apply(const BoolLayer& layer, char c) {
-		for (i64 i = 0; i < i64(n); i++) {
-			for (i64 j = 0; j < i64(m); j++) {
-				if (layer.get({i, j})) {
-					data[i][j] = c;
-				}
-			}
-		}
-	}
-
-	[[gnu::cold]]
-	void apply(const BulletLayer& layer) {
-		for (auto dir: DIRECTION_ARRAY) {
-			apply(layer.getBullets(dir), dirToChar(dir));
-		}
-	}
-
-	[[gnu::cold]]
-	void apply(const PlayerPositions& players) {
-		data[players.getHeroPosition().x][players.getHeroPosition().y] = 'H';
-		data[players.getEnemyPosition().x][players.getEnemyPosition().y] = 'E';
-	}
-
-	[[gnu::cold]]
-	void print() const {
-		for (i64 i = 0; i < i64(n); i++) {
-			for (i64 j = 0; j < i64(m); j++) {
-				std::cout << data[i][j];
-			}
-			std::cout << "\n";
-		}
-	}
-};
-
+/**
+ * @brief Cells a player may be in, if it moves anywhere (but into walls) every round.
+ */
+template <u64 N, u64 M>
 struct GhostPlayerLayer {
+	using Board = common::Bitboard<N, M>;
 private:
-	BoolLayer ghosts;
+	Board ghosts;
 public:
-	GhostPlayerLayer(Vec initial_pos): ghosts() {
-		ghosts.set(initial_pos, true);
+	GhostPlayerLayer(u64 initial_cell) {
+		ghosts.set(initial_cell);
 	}
 
-	const BoolLayer& getGhosts() const {
+	const Board& getGhosts() const {
 		return ghosts;
 	}
 
-	void eliminateGhostsAt(const BoolLayer& eliminations) {
-		#if BIT_SET == 1
-			ghosts.getBitsetMut() &= (~eliminations.getBitset());
-		#else
-			for (i64 i = 0; i < i64(nm); i++) {
-				ghosts.atIndexMut(i) &= (!eliminations.atIndex(i));
-			}
-		#endif
-	}
-
 	/**
-	 * @param bullets 
+	 * @param eliminations all bullets of the round (GameCore::occupied)
 	 * @return u64 number of ghosts after elimination
 	 */
-	u64 eliminateGhostsAt(const BulletLayer& bullets) {
-		#if BIT_SET == 1
-			auto eliminations =
-				bullets.getBullets(Direction::UP).getBitset() |
-				bullets.getBullets(Direction::DOWN).getBitset() |
-				bullets.getBullets(Direction::LEFT).getBitset() |
-				bullets.getBullets(Direction::RIGHT).getBitset();
-			
-			ghosts.getBitsetMut() &= (~eliminations);
-
-			return ghosts.getBitset().count();
-		#else 
-			// @note: isBulletAt is way faster then eliminateGhostsAt x4
-			u64 count = 0;
-			for (i64 i = 0; i < i64(nm); i++) {
-				ghosts.atIndexMut(i) &= (!bullets.isBulletAtIndex(i));
-				count += ghosts.atIndex(i);
-			}
-			return count;
-		#endif
+	u64 eliminateGhostsAt(const Board& eliminations) {
+		ghosts = ghosts.andNot(eliminations);
+		return ghosts.count();
 	}
 
-	void moveGhostsEverywhere(const BoolLayer& negative_walls) {
-		// @todo: no bound checks here -- should not be needed
-
-		// Try to avoid copy -- apparently its very similar the way it is
-		// It may be that compiler optimizes it much better
-
-		#if BIT_SET == 1
-			// @note: shift by 1 only works
-			// because we have walls on borders
-
-			std::bitset<nm> new_ghosts = ghosts.getBitset();
-			new_ghosts |= ghosts.getBitset() << m;
-			new_ghosts |= ghosts.getBitset() >> m;
-			new_ghosts |= ghosts.getBitset() << 1;
-			new_ghosts |= ghosts.getBitset() >> 1;
+	void moveGhostsEverywhere(const Board& negative_walls) {
+		// @note: shift by 1 only works
+		// because we have walls on borders
+		Board new_ghosts = ghosts;
+		new_ghosts |= ghosts.template shifted<i64(M)>();
+		new_ghosts |= ghosts.template shifted<-i64(M)>();
+		new_ghosts |= ghosts.template shifted<1>();
+		new_ghosts |= ghosts.template shifted<-1>();
 
-			new_ghosts &= negative_walls.getBitset();
+		new_ghosts &= negative_walls;
 
-			this->ghosts.getBitsetMut() = std::move(new_ghosts);
-		#else
-			BoolLayer new_ghosts = ghosts;
-
-			for (i64 i = 0; i < i64(nm); i++) {
-				if (ghosts.atIndex(i)) {
-					for (auto dir: DIRECTION_ARRAY) {
-						auto new_pos = moveIndexPos(i, dir);
-						new_ghosts.atIndexMut(new_pos) |= 
-							negative_walls.atIndex(new_pos);
-					}
-				}
-			}
-
-			// this is not faster :o:
-			// for (i64 i = 0; i < i64(nm); i++) {
-			// 	new_ghosts.atIndexMut(i) &= 
-			// 		(not walls.atIndex(i));
-			// }
-
-			this->ghosts = std::move(new_ghosts);
-		#endif
+		this->ghosts = new_ghosts;
 	}
 
-	void shootOnLayer(BulletLayer& bullets) const {
-		#if BIT_SET == 1
-			bullets.getBulletsMut(Direction::UP).getBitsetMut() |= ghosts.getBitset();
-			bullets.getBulletsMut(Direction::DOWN).getBitsetMut() |= ghosts.getBitset();
-			bullets.getBulletsMut(Direction::LEFT).getBitsetMut() |= ghosts.getBitset();
-			bullets.getBulletsMut(Direction::RIGHT).getBitsetMut() |= ghosts.getBitset();
-		#else
-			for (i64 i = 0; i < i64(nm); i++) {
-				bool shoot = ghosts.atIndex(i);
-				for (auto dir: DIRECTION_ARRAY) {
-					bullets.addBulletAtIndexIf(i, dir, shoot);
-				}
-			}
-		#endif
+	/**
+	 * @brief Every ghost shoots in every direction (bullets move with the next moveBullets).
+	 */
+	void shootOnLayer(std::array<Board, 4>& bullets) const {
+		for (auto& dir_bullets: bullets) {
+			dir_bullets |= ghosts;
+		}
 	}
 };
 
+template <u64 N, u64 M>
 struct GameState {
-	#if STATIC_WALLS == 1
-		static inline BoolLayer walls;
-	#else
-		BoolLayer walls;
-	#endif
-
-	BulletLayer bullets;
-	PlayerPositions players;
-	
-	void moveBullets() {
-		bullets.moveBulletsWithWalls(walls);
-	}
+	using Core  = common::GameCore<N, M>;
+	using Arena = common::Arena<N, M>;
+	using Board = common::Bitboard<N, M>;
 
-	[[gnu::cold]]
-	void debugPrint() const {
-		DebugPrintLayer printer;
-		printer.apply(players);
-		printer.apply(bullets);
-		printer.apply(walls, '#');
-		printer.print();
-		std::cout << "\n";
-	}
+	// walls and everything precomputed from them, set in readInput:
+	static inline Arena arena;
+	static inline Board negative_walls;
 
-	// struct BulletDiff {
-	// 	i64 index;
-	// 	bool value;
-	// };
-	// struct GoBackData {
-	// 	PlayerPositions old_players;
-	// 	BulletDiff bullet_diff[2];
-	// };
+	Core core;
 
 	void applyMove(Move hero_move, Move enemy_move) {
-		// 1. first perform players actions:
-
-		// GoBackData go_back = {
-		// 	players,
-		// 	// @todo: we know, there are no bullets here, since there are walls:
-		// 	{{0, false}, {1, false}}
-		// };
-
-		PlayerPositions old_positions = players;
-
-		for (auto [player, move]:
-			{std::pair{Player::HERO, hero_move},
-			{Player::ENEMY, enemy_move}}) {
-			
-			// @note: for now we don't bound check here
-			// @TODO: for now we allow "walk into walk"
-			// sensible move check should disallow it
-	
-			auto player_position_index = posToIndex(players.getPosition(player));
-			
-			#if UNSAFE_OTHERS
-				auto move_index = moveToIndex(move);
-				if (move_index < 4) {
-					players.getPosition(player) += dirToVec(DIRECTION_ARRAY[move_index]);
-				}
-				else if (move_index < 8) {
-					bullets.addBulletAtIndex(player_position_index, DIRECTION_ARRAY[move_index - 4]);
-				}
-
-			#else
-				switch (move) {
-					case Move::GO_UP:
-						players.getPosition(player) += dirToVec(Direction::UP);
-						break;
-					case Move::GO_DOWN:
-						players.getPosition(player) += dirToVec(Direction::DOWN);
-						break;
-					case Move::GO_LEFT:
-						players.getPosition(player) += dirToVec(Direction::LEFT);
-						break;
-					case Move::GO_RIGHT:
-						players.getPosition(player) += dirToVec(Direction::RIGHT);
-						break;
-					case Move::SHOOT_UP:
-						bullets.addBulletAtIndex(player_position_index, Direction::UP);
-						break;
-					case Move::SHOOT_DOWN:
-						bullets.addBulletAtIndex(player_position_index, Direction::DOWN);
-						break;
-					case Move::SHOOT_LEFT:
-						bullets.addBulletAtIndex(player_position_index, Direction::LEFT);
-						break;
-					case Move::SHOOT_RIGHT:
-						bullets.addBulletAtIndex(player_position_index, Direction::RIGHT);
-						break;
-					case Move::WAIT:
-						// do nothing
-						break;
-				}
-			#endif	
-		}
-
-		if (players.getHeroPosition() == players.getEnemyPosition()) {
-			players = old_positions;
-		}
-		
-		// 2. move bullets
-
-		this->moveBullets();
-
-		// @note: we don't check for players hit here
-		// it is done in the evaluation function and "isTerminal".
+		// @note: hits are checked in the evaluation function and "isTerminal".
+		core.step(arena, moveToIndex(hero_move), moveToIndex(enemy_move));
 	}
 
-	bool isMoveSensible(Move move, Player player) const {
-		if (move == Move::WAIT) {
-			// we assume that wait is always sensible
-			// so nothing can break in the algorithm
-			return true;
-		}
-		auto dir = moveToDir(move);
-		auto pos = players.getPosition(player);
-		auto new_pos = pos + dirToVec(dir);
-
-		// we don't shoot and don't walk into walls
-		// waiting is no worse then that
-		return not walls.get(new_pos);
+	/**
+	 * @return mask of sensible moves (we don't shoot and don't walk into walls,
+	 * waiting is no worse then that), bit k is move k
+	 */
+	common::MoveMask sensibleMoves(Player player) const {
+		return arena.moves.wallSafe(player == Player::HERO ? core.hero : core.enemy);
 	}
 
 	bool isTerminal() const {
-		return bullets.isBulletAtIndex(posToIndex(players.getHeroPosition()))
-			or bullets.isBulletAtIndex(posToIndex(players.getEnemyPosition()));
+		return core.finished();
 	}
 
 	PositionEvaluation evaluate() const {
-		bool hero_hit = bullets.isBulletAtIndex(posToIndex(players.getHeroPosition()));
-		bool enemy_hit = bullets.isBulletAtIndex(posToIndex(players.getEnemyPosition()));
-
-		if (hero_hit or enemy_hit) {
+		if (core.finished()) {
 			return {
-				hero_hit,
-				enemy_hit
+				core.hero_hit,
+				core.enemy_hit
 			};
 		}
 
 		// no hero hit
 		// no enemy hit
 
-		// @opt: this can be made static:
-		BoolLayer negative_walls = walls.negated();
-
 		SurvivalData hero_u;
 		SurvivalData hero_c;
 		SurvivalData enemy_u;
 		SurvivalData enemy_c;
 
-		auto lookup_bullets = this->bullets;
+		Core lookup_bullets = core;
 
-		GhostPlayerLayer hero_c_ghosts(players.getHeroPosition());
-		GhostPlayerLayer hero_u_ghosts(players.getHeroPosition());
+		GhostPlayerLayer<N, M> hero_c_ghosts(core.hero);
+		GhostPlayerLayer<N, M> hero_u_ghosts(core.hero);
 
-		GhostPlayerLayer enemy_c_ghosts(players.getEnemyPosition());
-		GhostPlayerLayer enemy_u_ghosts(players.getEnemyPosition());
+		GhostPlayerLayer<N, M> enemy_c_ghosts(core.enemy);
+		GhostPlayerLayer<N, M> enemy_u_ghosts(core.enemy);
 
-		BulletLayer hero_c_bullets = lookup_bullets;
-		BulletLayer enemy_c_bullets = lookup_bullets;
+		Core hero_c_bullets = lookup_bullets;
+		Core enemy_c_bullets = lookup_bullets;
 
 		// @TODO: make it less boilerplate'y
 
-		// @OPT making one struct here for quad opers
-		// could be way faster
-
 		u64 hc_count = 0;
 		u64 hu_count = 0;
 		u64 ec_count = 0;
@@ -1101,9 +419,9 @@ struct GameState {
 			// sim step:
 
 			// ghost shoots:
-			hero_c_ghosts.shootOnLayer(hero_c_bullets);
-			enemy_c_ghosts.shootOnLayer(enemy_c_bullets);
-			
+			hero_c_ghosts.shootOnLayer(hero_c_bullets.bullets);
+			enemy_c_ghosts.shootOnLayer(enemy_c_bullets.bullets);
+
 			// move ghosts:
 			hero_c_ghosts.moveGhostsEverywhere(negative_walls);
 			hero_u_ghosts.moveGhostsEverywhere(negative_walls);
@@ -1111,23 +429,18 @@ struct GameState {
 			enemy_u_ghosts.moveGhostsEverywhere(negative_walls);
 
 			// move bullets:
-			lookup_bullets.moveBulletsWithWalls(walls);
-			hero_c_bullets.moveBulletsWithWalls(walls);
-			enemy_c_bullets.moveBulletsWithWalls(walls);
-
-			// @OPT: flatten (and negate) lookup_bullets bullets here, might be faster, as compiler might not notice it
-			// once this is done, keeping enemy_c_bullets, hero_c_bullets,
-			// without lookup_bullets might be faster as well,
-			// since there will be faster propagation (less flips)
+			lookup_bullets.moveBullets(arena);
+			hero_c_bullets.moveBullets(arena);
+			enemy_c_bullets.moveBullets(arena);
 
 			// elim ghosts with walls (done in moveGhostsEverywhere)
 
 			// elim ghost with bullets:
-			hc_count = hero_c_ghosts.eliminateGhostsAt(lookup_bullets);
-			ec_count = enemy_c_ghosts.eliminateGhostsAt(lookup_bullets);
-			
-			hu_count = hero_u_ghosts.eliminateGhostsAt(enemy_c_bullets);
-			eu_count = enemy_u_ghosts.eliminateGhostsAt(hero_c_bullets);
+			hc_count = hero_c_ghosts.eliminateGhostsAt(lookup_bullets.occupied);
+			ec_count = enemy_c_ghosts.eliminateGhostsAt(lookup_bullets.occupied);
+
+			hu_count = hero_u_ghosts.eliminateGhostsAt(enemy_c_bullets.occupied);
+			eu_count = enemy_u_ghosts.eliminateGhostsAt(hero_c_bullets.occupied);
 
 			if (hc_count > 0) {
 				hero_c.round_count = i + 1;
@@ -1147,7 +460,7 @@ struct GameState {
 		hero_u.ghost_count  = hu_count;
 		enemy_c.ghost_count = ec_count;
 		enemy_u.ghost_count = eu_count;
-	
+
 		return {
 			hero_c,
 			hero_u,
@@ -1157,14 +470,15 @@ struct GameState {
 	}
 };
 
+template <u64 N, u64 M>
 struct ABGameState {
-	GameState state;
-	
-	// For now we assume that the game is full-information game, 
+	GameState<N, M> state;
+
+	// For now we assume that the game is full-information game,
 	// and that we have to commit our move first.
 	// This approach reduces possibility of random bad moves,
 	// but is not optimal.
-	// We might try to change it in the future.  
+	// We might try to change it in the future.
 	std::optional<Move> hero_move_commit;
 };
 
@@ -1182,9 +496,10 @@ namespace alpha_beta {
 
 	constinit static u64 leaf_counter = 0;
 
-	static inline ABGameState static_states[conf::AB_DEPTH * 2 + 2];
+	template <u64 N, u64 M>
+	inline ABGameState<N, M> static_states[conf::MAX_AB_DEPTH * 2 + 2];
 
-	template<bool INITIAL, bool IS_HERO_TURN>
+	template<u64 N, u64 M, bool INITIAL, bool IS_HERO_TURN>
 	auto alphaBeta(
 		u64 remaining_depth,
 		u64 state_depth,
@@ -1192,7 +507,7 @@ namespace alpha_beta {
 		PositionEvaluation beta)
 	-> ABRetType<INITIAL>::type	{
 
-		const auto& state = static_states[state_depth];
+		const auto& state = static_states<N, M>[state_depth];
 		
 		static_assert(implies(INITIAL, IS_HERO_TURN), "Initial call should be hero turn");
 		
@@ -1219,14 +534,14 @@ namespace alpha_beta {
 			PositionEvaluation value = PositionEvaluation::losing();
 			Move best_move = Move::WAIT;
 
-			for (auto move: MOVE_ARRAY)
-			if (state.state.isMoveSensible(move, Player::HERO)) {
+			for (u64 move_index: common::MaskMoves(state.state.sensibleMoves(Player::HERO))) {
+				const Move move = MOVE_ARRAY[move_index];
 
 				// @note: notice we operate on the same state here:
-				auto& new_state = static_states[state_depth];
+				auto& new_state = static_states<N, M>[state_depth];
 				new_state.hero_move_commit = move;
 
-				auto move_value = alphaBeta<false, not IS_HERO_TURN>(
+				auto move_value = alphaBeta<N, M, false, not IS_HERO_TURN>(
 					next_remaining_depth,
 					state_depth,
 					alpha,
@@ -1260,13 +575,13 @@ namespace alpha_beta {
 
 			PositionEvaluation value = PositionEvaluation::wining();
 
-			for (auto move: MOVE_ARRAY)
-			if (state.state.isMoveSensible(move, Player::ENEMY)) {
+			for (u64 move_index: common::MaskMoves(state.state.sensibleMoves(Player::ENEMY))) {
+				const Move move = MOVE_ARRAY[move_index];
 
 				// @opt
 				// we can move bullets once for each "GO" move.
 				// we could also try to preprocess "lookup_bullets"
-				auto& new_state = static_states[state_depth + 1];
+				auto& new_state = static_states<N, M>[state_depth + 1];
 
 				new_state = state;
 				// no need to clear it:
@@ -1282,7 +597,7 @@ namespace alpha_beta {
 
 				new_state.state.applyMove(hero_move, enemy_move);
 
-				auto move_value = alphaBeta<false, not IS_HERO_TURN>(
+				auto move_value = alphaBeta<N, M, false, not IS_HERO_TURN>(
 					next_remaining_depth,
 					state_depth + 1,
 					alpha,
@@ -1306,13 +621,14 @@ namespace alpha_beta {
 	}
 }
 
+template <u64 N, u64 M>
 [[gnu::cold]]
-Move findBestHeroMove(GameState state) {
-	ABGameState ab_state = {std::move(state), std::nullopt};
-	alpha_beta::static_states[0] = std::move(ab_state);
+Move findBestHeroMove(GameState<N, M> state) {
+	ABGameState<N, M> ab_state = {std::move(state), std::nullopt};
+	alpha_beta::static_states<N, M>[0] = std::move(ab_state);
 
-	auto res = alpha_beta::alphaBeta<true, true>(
-		conf::AB_DEPTH,
+	auto res = alpha_beta::alphaBeta<N, M, true, true>(
+		ab_depth,
 		0,
 		PositionEvaluation::losing(),
 		PositionEvaluation::wining()
@@ -1324,176 +640,57 @@ Move findBestHeroMove(GameState state) {
 	return res.first;
 }
 
-/** 
- * @note: it sets globals n, m, round_number
- * @return GameState 
+/**
+ * @note: it sets globals round_number, ab_depth and the arena
+ * @return GameState
  */
+template <u64 N, u64 M>
 [[gnu::cold]]
-GameState readInput() {
-	u64 local_n, local_m;
-	{
-		std::cin >> local_n >> local_m;
-		#if CONST_NM == 1
-			#if ALLOW_BIGGER_NM == 1
-				assert(local_n <= n);
-				assert(local_m <= m);
-			#else
-				assert(local_n == n);
-				assert(local_m == m);
-			#endif
-		#else 
-			::n = local_n;
-			::m = local_m;
-			::nm = ::n * ::m;
-		#endif
-		
-		assert(::nm == ::n * ::m);
+GameState<N, M> readInput(common::StdinBuffer& in) {
+	const auto input = common::parseInput<N, M>(in);
 
-		skipNewLine();
-		global_params_set = true;
-	}
+	::round_number = input.round_number;
 
-	QuadDirStorage<std::vector<Vec>> bullets;
-	
-	std::vector<Vec> walls;
-
-	Vec red_player;
-	Vec blue_player;
-
-	for (i64 i = 0; i < i64(local_n); i++) {
-		for (i64 j = 0; j < i64(local_m); j++) {
-			for (u64 dummy = 0; dummy < 4; dummy++) {
-				char c;
-				std::cin >> std::noskipws >> c;
-
-				Vec p = {i, j};
-
-				switch (c) {
-					case ' ':
-						break;
-					case '#':
-						walls.push_back(p);
-						break;
-					case 'R':
-						red_player = p;
-						break;
-					case 'B':
-						blue_player = p;
-						break;
-					case '>':
-						bullets.right().push_back(p);
-						break;
-					case '<':
-						bullets.left().push_back(p);
-						break;
-					case '^':
-						bullets.up().push_back(p);
-						break;
-					case 'v':
-						bullets.down().push_back(p);
-						break;
-					default:
-						throw std::logic_error("Invalid character");
-				}
-		
+	if (input.time_limit_ms > 0) {
+		common::TimeManager time_manager(conf::DEFAULT_TIME_US);
+		const double sharpness = common::tacticalScore(input.bullets, input.heroPosition(), input.enemyPosition());
+		const u64 moves_left = std::clamp<u64>(MAX_ROUND - std::min(MAX_ROUND, round_number), 10, 100);
+		time_manager.allocate(input.time_limit_ms, input.remaining_ms, moves_left, sharpness);
 
-			}
+		::ab_depth = 1;
+		while (::ab_depth < conf::MAX_AB_DEPTH and time_manager.allottedUs() >= conf::AB_DEPTH_MIN_US[::ab_depth]) {
+			::ab_depth++;
+		}
+		// quiet positions get less time, but never less than the default depth if it fits the hard limit:
+		if (::ab_depth < conf::AB_DEPTH and time_manager.hardUs() >= conf::AB_DEPTH_MIN_US[conf::AB_DEPTH - 1]) {
+			::ab_depth = conf::AB_DEPTH;
 		}
-		skipNewLine();
 	}
 
-	std::cin >> ::round_number;
-	skipNewLine();
-	
-	char who_are_we;
-	std::cin >> who_are_we;
-	assert(who_are_we == 'R' || who_are_we == 'B');
-
-	GameState game_state = {
-		#if STATIC_WALLS != 1
-			.walls = BoolLayer::fromVec(walls),
-		#endif
-		.bullets = {{
-			BoolLayer::fromVec(bullets.up()), 
-			BoolLayer::fromVec(bullets.down()),
-			BoolLayer::fromVec(bullets.left()),
-			BoolLayer::fromVec(bullets.right())
-		}},
-
-		.players = { who_are_we == 'R' ? red_player : blue_player,
-		             who_are_we == 'R' ? blue_player : red_player }
-	};
-
-	#if STATIC_WALLS == 1
-		GameState::walls = BoolLayer::fromVec(walls);
-	#endif
+	GameState<N, M>::arena = common::Arena<N, M>(input.walls);
+	GameState<N, M>::negative_walls = ~input.walls;
 
-	return game_state;
+	return { common::GameCore<N, M>::fromInput(input) };
 }
 
-[[maybe_unused]]
-[[gnu::cold]]
-void exampleScenario(GameState game_state) {
-	using enum Move;
-	std::cout << std::boolalpha;
-
-	game_state.debugPrint();
-
-	game_state.applyMove(WAIT, WAIT);
-	game_state.debugPrint();
-
-	game_state.applyMove(WAIT, WAIT);
-	game_state.debugPrint();
-	std::cout << game_state.isTerminal() << "\n";
-
-	game_state.applyMove(WAIT, GO_UP);
-	game_state.debugPrint();
-	std::cout << game_state.isTerminal() << "\n";
-
-	game_state.applyMove(SHOOT_UP, WAIT);
-	game_state.debugPrint();
-
-	game_state.applyMove(SHOOT_DOWN, GO_DOWN);
-	game_state.debugPrint();
-
-	game_state.applyMove(GO_UP, GO_LEFT);
-	game_state.debugPrint();
-
-	game_state.applyMove(GO_RIGHT, GO_LEFT);
-	game_state.debugPrint();
-
-	game_state.applyMove(GO_UP, GO_UP);
-	game_state.debugPrint();
+template <u64 N, u64 M>
+Move play(common::StdinBuffer& in) {
+	return findBestHeroMove(readInput<N, M>(in));
 }
 
-[[maybe_unused]]
+/**
+ * @brief Boards bigger than the compiled sizes (large map mode, common/large_map.hpp):
+ * no search, just a not stupid move (picked by the round number, so it stays deterministic).
+ */
 [[gnu::cold]]
-void ghostTest(GameState game_state) {
-	auto walls = game_state.walls;
-	auto bullets = game_state.bullets;
-
-	auto ghosts = GhostPlayerLayer(game_state.players.getHeroPosition());
-
-	for (u64 i = 0; i < 20; i++) {
-		// print:
-		DebugPrintLayer printer;
-		printer.apply(ghosts.getGhosts(), 'G');
-		printer.apply(bullets);
-		printer.apply(walls, '#');
-		printer.print();
-		std::cout << "\n";
-		std::cout << std::flush;
-
-		// move:
-		ghosts.moveGhostsEverywhere(walls);
-		bullets.moveBulletsWithWalls(walls);
-
-		// eliminations:
-		ghosts.eliminateGhostsAt(bullets);
-		// ghosts.eliminateGhostsAt(walls);
-		
-		
-	}
+Move playLarge(common::StdinBuffer& in) {
+	const auto input = common::parseLargeInput(in);
+	const common::LargeArena arena(input);
+
+	auto game = common::LargeGame::fromInput(input);
+	game.moveBullets(arena);
+	const common::MoveMask moves = game.notStupidMoves(arena, game.hero);
+	return MOVE_ARRAY[common::nthMove(moves, common::WAIT_FIRST_ORDER, input.round_number % common::moveCount(moves))];
 }
 
 }
@@ -1502,15 +699,20 @@ int main() {
 	std::ios_base::sync_with_stdio(false);
 	std::cin.tie(nullptr);
 
-	auto game_state = readInput();
+	common::StdinBuffer in;
+	const auto size = common::peekBoardSize(in);
 
-	// standard:
-	auto best_move = findBestHeroMove(std::move(game_state));
+	Move best_move;
+	if (size.n <= SMALL_N and size.m <= SMALL_M) {
+		best_move = play<SMALL_N, SMALL_M>(in);
+	}
+	else if (size.n <= common::MAX_N and size.m <= common::MAX_M) {
+		best_move = play<common::MAX_N, common::MAX_M>(in);
+	}
+	else {
+		best_move = playLarge(in);
+	}
 	std::cout << moveToIndex(best_move) << "\n";
-
-	// exampleScenario(game_state);
-	// ghostTest(game_state);
-	
 }
 
 
@@ -0,0 +1,84 @@
+// Per round cost of bullets in large map mode (common/large_map.hpp).
+// Build from solutions/: g++ -O2 -std=c++20 bench/large_map.cpp -o large_map_bench
+// Prints ns per round for each board size and bullet count, for every LargeBullets mode.
+// With few bullets the adaptive mode should follow the bullet count, not the area.
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "../common/large_map.hpp"
+
+using namespace common;
+
+namespace {
+
+constexpr u64 SIZES[] = {32, 64, 128, 256, 512};
+constexpr u64 BULLETS[] = {16, 128, 1024};
+// rounds are repeated until at least this much time passed:
+constexpr double MIN_SECONDS = 0.2;
+
+LargeInput randomBoard(u64 n, u64 m, u64 bullets, std::mt19937& rng) {
+	LargeInput res;
+	res.n = n;
+	res.m = m;
+	res.walls.assign(n * m, 0);
+	for (u64 i = 0; i < n; i++) {
+		for (u64 j = 0; j < m; j++) {
+			const bool border = i == 0 or j == 0 or i + 1 == n or j + 1 == m;
+			res.walls[i * m + j] = border or rng() % 30 == 0;
+		}
+	}
+	while (res.bullets.size() < bullets) {
+		const u64 cell = rng() % (n * m);
+		if (not res.walls[cell]) {
+			res.bullets.push_back(4 * cell + rng() % 4);
+		}
+	}
+	std::sort(res.bullets.begin(), res.bullets.end());
+	return res;
+}
+
+double nsPerRound(const LargeInput& input, LargeBullets::Mode mode) {
+	using Clock = std::chrono::steady_clock;
+	const LargeArena arena(input);
+	LargeBullets bullets(input.n, input.m, input.bullets, mode);
+
+	u64 rounds = 0;
+	u64 checksum = 0;
+	const auto start = Clock::now();
+	double seconds = 0;
+	while (seconds < MIN_SECONDS) {
+		for (u64 k = 0; k < 64; k++) {
+			bullets.step(arena);
+			// a hit check, as in every round of a game:
+			checksum += bullets.test(input.n / 2 * input.m + input.m / 2);
+		}
+		rounds += 64;
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	// keep the loop alive:
+	if (checksum == ~u64(0)) {
+		std::printf("%lu\n", checksum);
+	}
+	return seconds * 1e9 / rounds;
+}
+
+}
+
+int main() {
+	std::mt19937 rng(2024);
+	std::printf("%-9s %8s %12s %12s %12s\n", "board", "bullets", "adaptive", "sparse", "dense");
+	for (u64 size: SIZES) {
+		std::vector<u64> counts(std::begin(BULLETS), std::end(BULLETS));
+		// a crowded board as well:
+		counts.push_back(size * size / 8);
+		for (u64 count: counts) {
+			const LargeInput input = randomBoard(size, size, count, rng);
+			std::printf("%4lux%-4lu %8lu %9.0f ns %9.0f ns %9.0f ns\n", size, size, count,
+				nsPerRound(input, LargeBullets::Mode::ADAPTIVE),
+				nsPerRound(input, LargeBullets::Mode::SPARSE),
+				nsPerRound(input, LargeBullets::Mode::DENSE));
+		}
+	}
+}
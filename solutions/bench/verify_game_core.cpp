@@ -0,0 +1,58 @@
+// Driver of the GameCore vs GameLogic differential check (see bench/verify_game_core.py).
+// Build from solutions/: g++ -O2 -std=c++20 bench/verify_game_core.cpp -o verify_game_core
+// Input: a state as sent to an exec, then "k" and k pairs "<hero move> <enemy move>".
+// Plays the moves on GameCore (on the board size andr729 would use) and prints
+// "<hero hit> <enemy hit> <checksum>" every round (checksum as in GameLogic.stateChecksum),
+// until somebody is hit.
+
+#include <cstdio>
+
+#include "../common/game.hpp"
+#include "../common/protocol.hpp"
+
+using namespace common;
+
+namespace {
+
+template <u64 N, u64 M>
+void play(StdinBuffer& in) {
+	const auto input = parseInput<N, M>(in);
+	const Arena<N, M> arena(input.walls);
+	auto core = GameCore<N, M>::fromInput(input);
+
+	// referee indexes cells with the actual width:
+	auto cell = [&](u64 index) {
+		return index / M * input.m + index % M;
+	};
+	auto checksum = [&]() {
+		u64 sum = 0;
+		for (u64 dir = 0; dir < 4; dir++) {
+			core.bullets[dir].forEach([&](u64 index) { sum += bulletChecksum(cell(index), dir); });
+		}
+		const bool red = input.who == 'R';
+		sum += redChecksum(cell(red ? core.hero : core.enemy));
+		sum += blueChecksum(cell(red ? core.enemy : core.hero));
+		return sum;
+	};
+
+	const u64 rounds = in.readUnsigned();
+	for (u64 round = 0; round < rounds and not core.finished(); round++) {
+		const u64 hero_move  = in.readUnsigned();
+		const u64 enemy_move = in.readUnsigned();
+		core.step(arena, hero_move, enemy_move);
+		std::printf("%d %d %llu\n", int(core.hero_hit), int(core.enemy_hit), (unsigned long long)checksum());
+	}
+}
+
+}
+
+int main() {
+	StdinBuffer in;
+	const auto size = peekBoardSize(in);
+	if (size.n <= 15 and size.m <= 20) {
+		play<15, 20>(in);
+	}
+	else {
+		play<MAX_N, MAX_M>(in);
+	}
+}
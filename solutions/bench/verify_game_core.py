@@ -0,0 +1,64 @@
+# Differential check of the shared game core (common/game.hpp) against the referee rules
+# (GameLogic.applyMove), on random states and random moves.
+# Run from solutions/: python3 bench/verify_game_core.py [--states 300] [--rounds 60]
+# Every state is a few random rounds of a random map (randomGame in verify_karol.py), then both sides
+# play the same random moves and hits and the state checksum are compared every round.
+# Exit code is 1 if any state had a mismatch.
+
+import argparse
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+from verify_karol import randomGame, Game
+
+from internal.logic import Move, MoveProfile, PlayersID
+
+def refereeRounds(game: Game, who: PlayersID, moves: list[tuple[int, int]]) -> list[str]:
+	"""Lines the driver should print for the moves (hero move first)."""
+	res = []
+	for hero_move, enemy_move in moves:
+		profiles = [MoveProfile(hero_move), MoveProfile(enemy_move)]
+		if who == PlayersID.BLUE:
+			profiles.reverse()
+		hits = game.game_state.applyMove(Move(profiles))
+		enemy = PlayersID.BLUE if who == PlayersID.RED else PlayersID.RED
+		res.append(f"{int(who in hits)} {int(enemy in hits)} {game.game_state.stateChecksum()}")
+		if hits:
+			break
+	return res
+
+def main():
+	parser = argparse.ArgumentParser()
+	parser.add_argument("--states", type=int, default=300)
+	parser.add_argument("--rounds", type=int, default=60)
+	parser.add_argument("--seed", type=int, default=0)
+	args = parser.parse_args()
+
+	directory = os.path.dirname(os.path.abspath(__file__))
+	with tempfile.TemporaryDirectory() as build:
+		exec_path = os.path.join(build, "verify_game_core")
+		subprocess.run(["g++", "-O2", "-std=c++20", os.path.join(directory, "verify_game_core.cpp"), "-o", exec_path], check = True)
+
+		rng = random.Random(args.seed)
+		failed = 0
+		for k in range(args.states):
+			game = randomGame(rng)
+			who = rng.choice([PlayersID.RED, PlayersID.BLUE])
+			state = game.stateForUser(who)
+			moves = [(rng.randint(0, 8), rng.randint(0, 8)) for _ in range(args.rounds)]
+			driver_input = state + f"{len(moves)}\n" + "".join(f"{a} {b}\n" for a, b in moves)
+			proc = subprocess.run([exec_path], input = driver_input.encode(), capture_output = True)
+			expected = refereeRounds(game, who, moves)
+			got = proc.stdout.decode().split("\n")[:-1]
+			if proc.returncode != 0 or got != expected:
+				failed += 1
+				round = next((i for i, (a, b) in enumerate(zip(got, expected)) if a != b), min(len(got), len(expected)))
+				print(f"state {k}: first mismatch in round {round}\n{state}")
+	print(f"{args.states - failed}/{args.states} states ok")
+	sys.exit(1 if failed else 0)
+
+if __name__ == "__main__":
+	main()
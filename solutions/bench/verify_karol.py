@@ -0,0 +1,60 @@
+# Differential check of karol's bitboard rollout state (FastState and the bullet timeline)
+# against its GameState, on random states made by the Python referee.
+# Run from solutions/: python3 bench/verify_karol.py [--states 200] [--games 50]
+# Every state is a few random rounds of a random map (so bullets fly), karol is run with
+# "--verify K", which plays K random games with both states side by side.
+# Exit code is 1 if any state had a mismatch.
+
+import argparse
+import copy
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "python_impl"))
+
+from internal.runner import Game
+from internal.logic import Move, MoveProfile, PlayersID
+
+def randomGame(rng: random.Random) -> Game:
+	n, m = rng.randint(5, 20), rng.randint(5, 30)
+	game = Game(n, m, rng.randint(0, n * m // 10), "red", "blue", rng.getrandbits(32))
+	for _ in range(rng.randint(0, 30)):
+		before = copy.deepcopy(game.game_state)
+		if game.game_state.applyMove(Move([MoveProfile(rng.randint(0, 8)), MoveProfile(rng.randint(0, 8))])):
+			# a finished game is not a state anybody gets
+			game.game_state = before
+			break
+		game.round_number += 1
+	return game
+
+def randomState(rng: random.Random) -> str:
+	return randomGame(rng).stateForUser(rng.choice([PlayersID.RED, PlayersID.BLUE]))
+
+def main():
+	parser = argparse.ArgumentParser()
+	parser.add_argument("--states", type=int, default=200)
+	parser.add_argument("--games", type=int, default=50)
+	parser.add_argument("--seed", type=int, default=0)
+	args = parser.parse_args()
+
+	directory = os.path.dirname(os.path.abspath(__file__))
+	with tempfile.TemporaryDirectory() as build:
+		exec_path = os.path.join(build, "karol")
+		subprocess.run(["g++", "-O2", "-std=c++20", os.path.join(directory, "..", "karol.cpp"), "-o", exec_path], check = True)
+
+		rng = random.Random(args.seed)
+		failed = 0
+		for k in range(args.states):
+			state = randomState(rng)
+			proc = subprocess.run([exec_path, "--verify", str(args.games)], input = state.encode(), capture_output = True)
+			if proc.returncode != 0:
+				failed += 1
+				print(f"state {k}: {proc.stdout.decode().strip()}\n{state}")
+	print(f"{args.states - failed}/{args.states} states ok")
+	sys.exit(1 if failed else 0)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <bitset>
+#include <cstdint>
+
+namespace common {
+
+using u64 = uint64_t;
+using i64 = int64_t;
+
+/**
+ * @brief Set of cells of a (at most) N x M board.
+ * Cell (i, j) is stored as bit i * M + j, so the row stride is always M,
+ * even if the actual board is smaller.
+ */
+template <u64 N, u64 M>
+struct Bitboard {
+	static constexpr u64 ROWS  = N;
+	static constexpr u64 COLS  = M;
+	static constexpr u64 CELLS = N * M;
+	static constexpr u64 WORDS = (CELLS + 63) / 64;
+
+	// mask of used bits in the last word
+	static constexpr u64 LAST_MASK =
+		CELLS % 64 == 0 ? ~u64(0) : (u64(1) << (CELLS % 64)) - 1;
+
+	std::array<u64, WORDS> words{};
+
+	static constexpr u64 index(u64 i, u64 j) {
+		return i * M + j;
+	}
+
+	bool test(u64 index) const {
+		return (words[index / 64] >> (index % 64)) & 1;
+	}
+
+	void set(u64 index) {
+		words[index / 64] |= u64(1) << (index % 64);
+	}
+
+	void reset(u64 index) {
+		words[index / 64] &= ~(u64(1) << (index % 64));
+	}
+
+	void clear() {
+		words.fill(0);
+	}
+
+	bool any() const {
+		u64 acc = 0;
+		for (auto w: words) {
+			acc |= w;
+		}
+		return acc != 0;
+	}
+
+	u64 count() const {
+		u64 res = 0;
+		for (auto w: words) {
+			res += std::popcount(w);
+		}
+		return res;
+	}
+
+	Bitboard& operator&=(const Bitboard& other) {
+		for (u64 i = 0; i < WORDS; i++) {
+			words[i] &= other.words[i];
+		}
+		return *this;
+	}
+
+	Bitboard& operator|=(const Bitboard& other) {
+		for (u64 i = 0; i < WORDS; i++) {
+			words[i] |= other.words[i];
+		}
+		return *this;
+	}
+
+	Bitboard& operator^=(const Bitboard& other) {
+		for (u64 i = 0; i < WORDS; i++) {
+			words[i] ^= other.words[i];
+		}
+		return *this;
+	}
+
+	Bitboard operator&(const Bitboard& other) const {
+		Bitboard res = *this;
+		return res &= other;
+	}
+
+	Bitboard operator|(const Bitboard& other) const {
+		Bitboard res = *this;
+		return res |= other;
+	}
+
+	Bitboard operator^(const Bitboard& other) const {
+		Bitboard res = *this;
+		return res ^= other;
+	}
+
+	Bitboard operator~() const {
+		Bitboard res;
+		for (u64 i = 0; i < WORDS; i++) {
+			res.words[i] = ~words[i];
+		}
+		res.words[WORDS - 1] &= LAST_MASK;
+		return res;
+	}
+
+	bool operator==(const Bitboard& other) const = default;
+
+	/**
+	 * @brief this & ~other, without building ~other
+	 */
+	Bitboard andNot(const Bitboard& other) const {
+		Bitboard res;
+		for (u64 i = 0; i < WORDS; i++) {
+			res.words[i] = words[i] & ~other.words[i];
+		}
+		return res;
+	}
+
+	/**
+	 * @brief Same as shifted(AMOUNT), but with the amount known at compile time,
+	 * so the loop is fully unrolled (used in hot loops).
+	 */
+	template <i64 AMOUNT>
+	Bitboard shifted() const {
+		constexpr u64 word_shift = (AMOUNT >= 0 ? u64(AMOUNT) : u64(-AMOUNT)) / 64;
+		constexpr u64 bit_shift  = (AMOUNT >= 0 ? u64(AMOUNT) : u64(-AMOUNT)) % 64;
+		Bitboard res;
+		if constexpr (AMOUNT >= 0) {
+			for (u64 i = word_shift; i < WORDS; i++) {
+				u64 w = words[i - word_shift] << bit_shift;
+				if constexpr (bit_shift != 0) {
+					if (i > word_shift) {
+						w |= words[i - word_shift - 1] >> (64 - bit_shift);
+					}
+				}
+				res.words[i] = w;
+			}
+			res.words[WORDS - 1] &= LAST_MASK;
+		}
+		else {
+			for (u64 i = 0; i + word_shift < WORDS; i++) {
+				u64 w = words[i + word_shift] >> bit_shift;
+				if constexpr (bit_shift != 0) {
+					if (i + word_shift + 1 < WORDS) {
+						w |= words[i + word_shift + 1] << (64 - bit_shift);
+					}
+				}
+				res.words[i] = w;
+			}
+		}
+		return res;
+	}
+
+	/**
+	 * @brief Moves every cell by `amount` towards higher indices
+	 * (negative amount moves towards lower ones). Bits shifted out are lost.
+	 */
+	Bitboard shifted(i64 amount) const {
+		Bitboard res;
+		if (amount >= 0) {
+			const u64 word_shift = u64(amount) / 64;
+			const u64 bit_shift  = u64(amount) % 64;
+			for (u64 i = WORDS; i-- > word_shift;) {
+				u64 w = words[i - word_shift] << bit_shift;
+				if (bit_shift != 0 and i > word_shift) {
+					w |= words[i - word_shift - 1] >> (64 - bit_shift);
+				}
+				res.words[i] = w;
+			}
+			res.words[WORDS - 1] &= LAST_MASK;
+		}
+		else {
+			const u64 word_shift = u64(-amount) / 64;
+			const u64 bit_shift  = u64(-amount) % 64;
+			for (u64 i = 0; i + word_shift < WORDS; i++) {
+				u64 w = words[i + word_shift] >> bit_shift;
+				if (bit_shift != 0 and i + word_shift + 1 < WORDS) {
+					w |= words[i + word_shift + 1] << (64 - bit_shift);
+				}
+				res.words[i] = w;
+			}
+		}
+		return res;
+	}
+
+	/**
+	 * @brief Calls f(index) for every set cell, in increasing order.
+	 */
+	template <typename F>
+	void forEach(F f) const {
+		for (u64 i = 0; i < WORDS; i++) {
+			u64 w = words[i];
+			while (w != 0) {
+				f(i * 64 + std::countr_zero(w));
+				w &= w - 1;
+			}
+		}
+	}
+
+	std::bitset<CELLS> toBitset() const {
+		std::bitset<CELLS> res;
+		forEach([&](u64 index) { res.set(index); });
+		return res;
+	}
+};
+
+/**
+ * @brief One step of bullets flying in one direction: bullets of `moving`
+ * not blocked by a wall move by SHIFT, and blocked bullets of the opposite
+ * direction (`turning`) turn back in place.
+ * Done in one pass over words, as it is the hottest loop of rollouts.
+ */
+template <i64 SHIFT, u64 N, u64 M>
+Bitboard<N, M> bulletStep(
+	const Bitboard<N, M>& moving, const Bitboard<N, M>& moving_blocked,
+	const Bitboard<N, M>& turning, const Bitboard<N, M>& turning_blocked) {
+
+	using Board = Bitboard<N, M>;
+	constexpr u64 W = Board::WORDS;
+
+	if constexpr (SHIFT >= 64 or SHIFT <= -64) {
+		return moving.andNot(moving_blocked).template shifted<SHIFT>() | (turning & turning_blocked);
+	}
+	else {
+		// padded with zero words on both sides:
+		u64 src[W + 2];
+		src[0] = 0;
+		src[W + 1] = 0;
+		for (u64 i = 0; i < W; i++) {
+			src[i + 1] = moving.words[i] & ~moving_blocked.words[i];
+		}
+
+		Board res;
+		for (u64 i = 0; i < W; i++) {
+			u64 w;
+			if constexpr (SHIFT > 0) {
+				w = (src[i + 1] << SHIFT) | (src[i] >> (64 - SHIFT));
+			}
+			else {
+				w = (src[i + 1] >> -SHIFT) | (src[i + 2] << (64 + SHIFT));
+			}
+			res.words[i] = w | (turning.words[i] & turning_blocked.words[i]);
+		}
+		res.words[W - 1] &= Board::LAST_MASK;
+		return res;
+	}
+}
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "bitboard.hpp"
+
+namespace common {
+
+/**
+ * @brief Cells occupied by the known bullets (e.g. from the input) in the following rounds.
+ * One bitboard per round, so the whole table is a few cache lines
+ * and "is this cell hit at round r" is a single bit test.
+ */
+template <u64 N, u64 M>
+struct BulletTimeline {
+	using Board = Bitboard<N, M>;
+
+	static constexpr uint8_t NO_HIT = 0xff;
+	static constexpr u64 NO_HIT_ROUND = ~u64(0);
+
+	u64 first_round = 0;
+	// frames[k] -- bullets at round first_round + k
+	std::vector<Board> frames;
+	// first frame in which the cell is hit (NO_HIT if never in the timeline)
+	std::array<uint8_t, N * M> first_hit;
+
+	/**
+	 * @param bullets indexed with InputDir, at round first_round
+	 * @param depth number of simulated rounds (there are depth + 1 frames), less than NO_HIT
+	 */
+	void build(const Board& walls, std::array<Board, 4> bullets, u64 first_round, u64 depth) {
+		this->first_round = first_round;
+
+		std::array<Board, 4> blocked = {
+			walls.template shifted<i64(M)>(),
+			walls.template shifted<-i64(M)>(),
+			walls.template shifted<1>(),
+			walls.template shifted<-1>(),
+		};
+
+		frames.resize(depth + 1);
+		for (u64 k = 0; k <= depth; k++) {
+			frames[k] = bullets[0] | bullets[1] | bullets[2] | bullets[3];
+			bullets = {
+				bulletStep<-i64(M)>(bullets[0], blocked[0], bullets[1], blocked[1]),
+				bulletStep<i64(M)>(bullets[1], blocked[1], bullets[0], blocked[0]),
+				bulletStep<-1>(bullets[2], blocked[2], bullets[3], blocked[3]),
+				bulletStep<1>(bullets[3], blocked[3], bullets[2], blocked[2]),
+			};
+		}
+
+		first_hit.fill(NO_HIT);
+		for (u64 k = frames.size(); k-- > 0;) {
+			frames[k].forEach([&](u64 cell) { first_hit[cell] = k; });
+		}
+	}
+
+	u64 lastRound() const {
+		return first_round + frames.size() - 1;
+	}
+
+	const Board& at(u64 round) const {
+		return frames[round - first_round];
+	}
+
+	bool hit(u64 round, u64 cell) const {
+		return frames[round - first_round].test(cell);
+	}
+
+	/**
+	 * @return first round >= from_round in which the cell is hit, or NO_HIT_ROUND
+	 */
+	u64 firstHit(u64 cell, u64 from_round) const {
+		if (first_hit[cell] == NO_HIT) {
+			return NO_HIT_ROUND;
+		}
+		if (first_round + first_hit[cell] >= from_round) {
+			return first_round + first_hit[cell];
+		}
+		for (u64 round = from_round; round <= lastRound(); round++) {
+			if (hit(round, cell)) {
+				return round;
+			}
+		}
+		return NO_HIT_ROUND;
+	}
+};
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "bitboard.hpp"
+#include "input.hpp"
+#include "move_gen.hpp"
+
+namespace common {
+
+/**
+ * @brief Largest board bots are compiled for (default board of the runner).
+ * Smaller boards use the same stride, see Bitboard.
+ */
+constexpr u64 MAX_N = 20;
+constexpr u64 MAX_M = 30;
+
+/**
+ * @brief Static part of the game: walls and everything precomputed from them.
+ * Built once per input and shared (read only) by all states and threads.
+ */
+template <u64 N, u64 M>
+struct Arena {
+	using Board = Bitboard<N, M>;
+
+	// cell shift of a direction (indexed like InputDir and moves 0-3):
+	static constexpr std::array<i64, 4> SHIFT = {-i64(M), i64(M), -1, 1};
+
+	Board walls;
+	// blocked[dir] -- cells whose neighbour in the direction is a wall
+	std::array<Board, 4> blocked;
+	MoveGen<N, M> moves;
+
+	Arena() = default;
+
+	explicit Arena(const Board& walls)
+		: walls(walls), moves(walls) {
+		for (u64 dir = 0; dir < 4; dir++) {
+			blocked[dir] = walls.shifted(-SHIFT[dir]);
+		}
+	}
+
+	/**
+	 * @brief One round of bullets: a bullet moves, or (when facing a wall) turns back in place.
+	 */
+	void moveBullets(std::array<Board, 4>& bullets) const {
+		bullets = {
+			bulletStep<-i64(M)>(bullets[0], blocked[0], bullets[1], blocked[1]),
+			bulletStep<i64(M)>(bullets[1], blocked[1], bullets[0], blocked[0]),
+			bulletStep<-1>(bullets[2], blocked[2], bullets[3], blocked[3]),
+			bulletStep<1>(bullets[3], blocked[3], bullets[2], blocked[2]),
+		};
+	}
+
+	/**
+	 * @return cell after the move (the same cell if it is not a go move or it goes into a wall)
+	 */
+	u64 walk(u64 cell, u64 move) const {
+		if (move >= 4 or blocked[move].test(cell)) {
+			return cell;
+		}
+		return cell + SHIFT[move];
+	}
+};
+
+/**
+ * @brief Dynamic part of the game, from the hero point of view, no heap allocations.
+ * Bullets are one bitboard per direction (two bullets in the same cell and direction
+ * are one bullet, they can't be told apart anyway).
+ *
+ * A round is split in two, so move generation can look at the bullets of the next round:
+ * moveBullets() and then movePlayers(). Shots are added already moved,
+ * which is the same as the referee order (GameLogic.applyMove: players, then bullets).
+ */
+template <u64 N, u64 M>
+struct GameCore {
+	using Board = Bitboard<N, M>;
+	using Arena = common::Arena<N, M>;
+
+	u64 round = 0;
+	u64 hero  = 0;
+	u64 enemy = 0;
+	bool hero_hit  = false;
+	bool enemy_hit = false;
+
+	// indexed with InputDir
+	std::array<Board, 4> bullets;
+	// all bullets of the round, callers may add more (e.g. bullets known from a timeline)
+	Board occupied;
+
+	static GameCore fromInput(const ParsedInput<N, M>& input) {
+		GameCore res;
+		res.round = input.round_number;
+		res.hero  = input.heroPosition();
+		res.enemy = input.enemyPosition();
+		res.bullets = input.bullets;
+		res.updateOccupied();
+		return res;
+	}
+
+	bool finished() const {
+		return hero_hit or enemy_hit;
+	}
+
+	void updateOccupied() {
+		occupied = bullets[0] | bullets[1] | bullets[2] | bullets[3];
+	}
+
+	void moveBullets(const Arena& arena) {
+		round++;
+		arena.moveBullets(bullets);
+		updateOccupied();
+	}
+
+	/**
+	 * @brief Bullet shot from the cell, after its first step.
+	 */
+	void addBullet(const Arena& arena, u64 cell, u64 dir) {
+		if (arena.blocked[dir].test(cell)) {
+			dir ^= 1;
+		}
+		else {
+			cell += Arena::SHIFT[dir];
+		}
+		bullets[dir].set(cell);
+		occupied.set(cell);
+	}
+
+	/**
+	 * @brief Second half of the round (after moveBullets), sets hits.
+	 * Players that would end in the same cell both stay.
+	 */
+	void movePlayers(const Arena& arena, u64 hero_move, u64 enemy_move) {
+		if (4 <= enemy_move and enemy_move < 8) {
+			addBullet(arena, enemy, enemy_move - 4);
+		}
+		if (4 <= hero_move and hero_move < 8) {
+			addBullet(arena, hero, hero_move - 4);
+		}
+
+		const u64 new_hero  = arena.walk(hero, hero_move);
+		const u64 new_enemy = arena.walk(enemy, enemy_move);
+		if (new_hero != new_enemy) {
+			hero  = new_hero;
+			enemy = new_enemy;
+		}
+
+		hero_hit  = occupied.test(hero);
+		enemy_hit = occupied.test(enemy);
+	}
+
+	void step(const Arena& arena, u64 hero_move, u64 enemy_move) {
+		moveBullets(arena);
+		movePlayers(arena, hero_move, enemy_move);
+	}
+
+	/**
+	 * @brief Not stupid moves of a player (see MoveGen::notStupid), call after moveBullets.
+	 */
+	MoveMask notStupidMoves(const Arena& arena, u64 cell) const {
+		return arena.moves.notStupid(cell, occupied);
+	}
+};
+
+}
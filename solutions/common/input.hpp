@@ -0,0 +1,390 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.hpp"
+
+namespace common {
+
+/**
+ * @brief Whole-input reader for stdin.
+ * If stdin is a regular file it is mmaped, otherwise it is read
+ * with as few `read` calls as possible (usually one, as the referee writes
+ * the whole state before we start).
+ * Bytes are pulled lazily, so it also works with a pipe that stays open.
+ */
+class StdinBuffer {
+private:
+	const char* data = nullptr;
+	u64 size   = 0;
+	u64 cursor = 0;
+	bool mapped = false;
+	bool eof    = false;
+	std::vector<char> storage;
+
+	[[gnu::cold]]
+	void fill(u64 needed) {
+		while (size < needed and not eof) {
+			if (storage.size() < needed) {
+				storage.resize(std::max<u64>(needed, 2 * storage.size()));
+			}
+			auto got = ::read(0, storage.data() + size, storage.size() - size);
+			if (got <= 0) {
+				eof = true;
+				break;
+			}
+			size += got;
+			data = storage.data();
+		}
+	}
+
+public:
+	StdinBuffer() {
+		struct stat st;
+		if (fstat(0, &st) == 0 and S_ISREG(st.st_mode) and st.st_size > 0) {
+			void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+			if (ptr != MAP_FAILED) {
+				data   = static_cast<const char*>(ptr);
+				size   = st.st_size;
+				mapped = true;
+				eof    = true;
+				return;
+			}
+		}
+		storage.resize(1 << 16);
+	}
+
+	StdinBuffer(const StdinBuffer&) = delete;
+	StdinBuffer& operator=(const StdinBuffer&) = delete;
+
+	~StdinBuffer() {
+		if (mapped) {
+			munmap(const_cast<char*>(data), size);
+		}
+	}
+
+	/**
+	 * @return true if at least `count` bytes are available past the cursor
+	 */
+	bool ensure(u64 count) {
+		if (cursor + count > size) [[unlikely]] {
+			fill(cursor + count);
+		}
+		return cursor + count <= size;
+	}
+
+	const char* here() const {
+		return data + cursor;
+	}
+
+	void advance(u64 count) {
+		cursor += count;
+	}
+
+	void skipSpaces() {
+		while (ensure(1) and (data[cursor] == ' ' or data[cursor] == '\n' or data[cursor] == '\r')) {
+			cursor++;
+		}
+	}
+
+	u64 readUnsigned() {
+		skipSpaces();
+		u64 res = 0;
+		while (ensure(1) and data[cursor] >= '0' and data[cursor] <= '9') {
+			res = res * 10 + (data[cursor] - '0');
+			cursor++;
+		}
+		return res;
+	}
+
+	i64 readSigned() {
+		skipSpaces();
+		if (ensure(1) and data[cursor] == '-') {
+			cursor++;
+			return -i64(readUnsigned());
+		}
+		return readUnsigned();
+	}
+
+	char readChar() {
+		skipSpaces();
+		if (not ensure(1)) {
+			return '\0';
+		}
+		return data[cursor++];
+	}
+};
+
+enum InputDir {
+	INPUT_UP    = 0,
+	INPUT_DOWN  = 1,
+	INPUT_LEFT  = 2,
+	INPUT_RIGHT = 3,
+};
+
+/**
+ * @brief Decoded referee input.
+ * Positions are cell indexes in Bitboard<N, M> layout.
+ */
+template <u64 N, u64 M>
+struct ParsedInput {
+	using Board = Bitboard<N, M>;
+
+	u64 n = 0;
+	u64 m = 0;
+	u64 round_number = 0;
+	char who = 'R';
+
+	Board walls;
+	// indexed with InputDir
+	std::array<Board, 4> bullets;
+
+	u64 red  = 0;
+	u64 blue = 0;
+
+	// clock of this move (see common::TimeManager), 0 if not sent
+	u64 time_limit_ms = 0;
+	u64 remaining_ms  = 0;
+
+	u64 heroPosition() const {
+		return who == 'R' ? red : blue;
+	}
+
+	u64 enemyPosition() const {
+		return who == 'R' ? blue : red;
+	}
+
+	Board allBullets() const {
+		return bullets[0] | bullets[1] | bullets[2] | bullets[3];
+	}
+};
+
+namespace detail {
+	// Tile is 4 chars: [wall/player/up, down, left, right].
+	// It is loaded as one little endian u32, so char k is byte k.
+	constexpr uint32_t byteAt(uint32_t tile, u64 k) {
+		return (tile >> (8 * k)) & 0xff;
+	}
+
+	/**
+	 * @brief Decodes one row of the board into bitboards.
+	 * One pass over the row, no branches on the content,
+	 * so compiler is free to vectorize comparisons.
+	 */
+	template <u64 N, u64 M>
+	void decodeRow(const char* row, u64 i, u64 m, ParsedInput<N, M>& out) {
+		u64 red_mask  = 0;
+		u64 blue_mask = 0;
+		for (u64 j = 0; j < m; j++) {
+			uint32_t tile;
+			std::memcpy(&tile, row + 4 * j, 4);
+
+			const u64 idx = i * M + j;
+			const u64 w   = idx / 64;
+			const u64 bit = u64(1) << (idx % 64);
+
+			const u64 c0 = byteAt(tile, 0);
+
+			out.walls.words[w]               |= bit & -u64(c0 == '#');
+			out.bullets[INPUT_UP].words[w]    |= bit & -u64(c0 == '^');
+			out.bullets[INPUT_DOWN].words[w]  |= bit & -u64(byteAt(tile, 1) == 'v');
+			out.bullets[INPUT_LEFT].words[w]  |= bit & -u64(byteAt(tile, 2) == '<');
+			out.bullets[INPUT_RIGHT].words[w] |= bit & -u64(byteAt(tile, 3) == '>');
+
+			// branchless "last found" for players:
+			red_mask  = c0 == 'R' ? idx + 1 : red_mask;
+			blue_mask = c0 == 'B' ? idx + 1 : blue_mask;
+		}
+		if (red_mask != 0) {
+			out.red = red_mask - 1;
+		}
+		if (blue_mask != 0) {
+			out.blue = blue_mask - 1;
+		}
+	}
+}
+
+/**
+ * @brief Binary state format (see STATE_FORMATS in python_impl/internal/runner.py):
+ * 24 byte header followed by 7 bitplanes of ceil(n * m / 64) little endian words.
+ */
+constexpr char BINARY_MAGIC[4] = {'O', 'F', 'F', 'B'};
+constexpr u64 BINARY_HEADER_SIZE = 24;
+
+namespace detail {
+	template <u64 N, u64 M>
+	void loadPlane(const char* src, u64 n, u64 m, Bitboard<N, M>& out) {
+		const u64 words = (n * m + 63) / 64;
+		if (m == M) {
+			// same stride -- it is already our layout:
+			std::memcpy(out.words.data(), src, 8 * words);
+			return;
+		}
+		for (u64 w = 0; w < words; w++) {
+			u64 word;
+			std::memcpy(&word, src + 8 * w, 8);
+			while (word != 0) {
+				const u64 idx = w * 64 + std::countr_zero(word);
+				out.set(Bitboard<N, M>::index(idx / m, idx % m));
+				word &= word - 1;
+			}
+		}
+	}
+
+	template <u64 N, u64 M>
+	u64 loadPosition(const char* src, u64 n, u64 m) {
+		Bitboard<N, M> plane;
+		loadPlane(src, n, m, plane);
+		u64 res = 0;
+		plane.forEach([&](u64 index) { res = index; });
+		return res;
+	}
+
+	template <u64 N, u64 M>
+	ParsedInput<N, M> parseBinaryInput(StdinBuffer& in) {
+		ParsedInput<N, M> res;
+
+		if (not in.ensure(BINARY_HEADER_SIZE)) {
+			throw std::logic_error("Unexpected end of input");
+		}
+		uint16_t n, m;
+		uint32_t round_number, time_limit_ms, remaining_ms;
+		std::memcpy(&n, in.here() + 4, 2);
+		std::memcpy(&m, in.here() + 6, 2);
+		std::memcpy(&round_number, in.here() + 8, 4);
+		std::memcpy(&time_limit_ms, in.here() + 16, 4);
+		std::memcpy(&remaining_ms, in.here() + 20, 4);
+		res.n = n;
+		res.m = m;
+		res.round_number = round_number;
+		res.who = in.here()[12];
+		res.time_limit_ms = time_limit_ms;
+		res.remaining_ms  = remaining_ms;
+		in.advance(BINARY_HEADER_SIZE);
+
+		if (res.n > N or res.m > M) {
+			throw std::logic_error("Board too big");
+		}
+
+		const u64 plane_size = 8 * ((res.n * res.m + 63) / 64);
+		if (not in.ensure(7 * plane_size)) {
+			throw std::logic_error("Unexpected end of input");
+		}
+		const char* planes = in.here();
+		loadPlane(planes, res.n, res.m, res.walls);
+		for (u64 dir = 0; dir < 4; dir++) {
+			loadPlane(planes + (1 + dir) * plane_size, res.n, res.m, res.bullets[dir]);
+		}
+		res.red  = loadPosition<N, M>(planes + 5 * plane_size, res.n, res.m);
+		res.blue = loadPosition<N, M>(planes + 6 * plane_size, res.n, res.m);
+		in.advance(7 * plane_size);
+
+		assert(res.who == 'R' or res.who == 'B');
+		return res;
+	}
+}
+
+struct BoardSize {
+	u64 n = 0;
+	u64 m = 0;
+};
+
+/**
+ * @brief Board size of the state, without consuming it (only leading spaces are skipped),
+ * so a bot can pick the engine (e.g. large map mode) before parsing.
+ */
+inline BoardSize peekBoardSize(StdinBuffer& in) {
+	in.skipSpaces();
+	BoardSize res;
+	if (in.ensure(BINARY_HEADER_SIZE) and std::memcmp(in.here(), BINARY_MAGIC, 4) == 0) {
+		uint16_t n, m;
+		std::memcpy(&n, in.here() + 4, 2);
+		std::memcpy(&m, in.here() + 6, 2);
+		return {n, m};
+	}
+
+	u64 offset = 0;
+	auto readAt = [&]() {
+		u64 value = 0;
+		while (in.ensure(offset + 1) and in.here()[offset] == ' ') {
+			offset++;
+		}
+		while (in.ensure(offset + 1) and in.here()[offset] >= '0' and in.here()[offset] <= '9') {
+			value = value * 10 + (in.here()[offset] - '0');
+			offset++;
+		}
+		return value;
+	};
+	res.n = readAt();
+	res.m = readAt();
+	return res;
+}
+
+/**
+ * @brief Parses the state produced by the referee.
+ * Text format: "n m", n rows of 4 * m chars, round number, player char
+ * and "<time limit ms> <remaining budget ms>" (missing values are 0).
+ * Binary format is recognized by its magic.
+ */
+template <u64 N, u64 M>
+ParsedInput<N, M> parseInput(StdinBuffer& in) {
+	in.skipSpaces();
+	if (in.ensure(4) and std::memcmp(in.here(), BINARY_MAGIC, 4) == 0) {
+		return detail::parseBinaryInput<N, M>(in);
+	}
+
+	ParsedInput<N, M> res;
+
+	res.n = in.readUnsigned();
+	res.m = in.readUnsigned();
+	if (res.n > N or res.m > M) {
+		throw std::logic_error("Board too big");
+	}
+
+	// skip the end of the header line:
+	while (in.ensure(1) and *in.here() != '\n') {
+		in.advance(1);
+	}
+	in.advance(1);
+
+	const u64 row_len = 4 * res.m;
+	for (u64 i = 0; i < res.n; i++) {
+		if (not in.ensure(row_len)) {
+			throw std::logic_error("Unexpected end of input");
+		}
+		detail::decodeRow(in.here(), i, res.m, res);
+		in.advance(row_len);
+
+		// row end (tolerates "\r\n"):
+		while (in.ensure(1) and *in.here() != '\n') {
+			in.advance(1);
+		}
+		in.advance(1);
+	}
+
+	res.round_number = in.readUnsigned();
+	res.who = in.readChar();
+	assert(res.who == 'R' or res.who == 'B');
+
+	res.time_limit_ms = in.readUnsigned();
+	res.remaining_ms  = in.readUnsigned();
+
+	return res;
+}
+
+template <u64 N, u64 M>
+ParsedInput<N, M> parseInput() {
+	StdinBuffer in;
+	return parseInput<N, M>(in);
+}
+
+}
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <utility>
+
+#include "bitboard.hpp"
+
+namespace common {
+
+/**
+ * @brief xoshiro256** -- every output bit is a random bit for one lane.
+ */
+struct LaneRng {
+	u64 s[4];
+
+	explicit LaneRng(u64 seed = 1) {
+		// splitmix64 to fill the state:
+		for (auto& word: s) {
+			seed += 0x9E3779B97F4A7C15ull;
+			u64 z = seed;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			word = z ^ (z >> 31);
+		}
+	}
+
+	u64 operator()() {
+		const u64 res = std::rotl(s[1] * 5, 7) * 9;
+		const u64 t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = std::rotl(s[3], 45);
+		return res;
+	}
+};
+
+/**
+ * @brief 4 bit unsigned number per lane, bit-sliced: bits[j] holds bit j of all lanes.
+ */
+struct LaneNibble {
+	u64 bits[4] = {0, 0, 0, 0};
+
+	static LaneNibble constant(u64 value) {
+		LaneNibble res;
+		for (u64 j = 0; j < 4; j++) {
+			res.bits[j] = ((value >> j) & 1) ? ~u64(0) : 0;
+		}
+		return res;
+	}
+
+	// +1 in lanes from the mask (no overflow check)
+	void increment(u64 mask) {
+		u64 carry = mask;
+		for (u64 j = 0; j < 4; j++) {
+			const u64 b = bits[j];
+			bits[j] = b ^ carry;
+			carry &= b;
+		}
+	}
+
+	u64 equal(const LaneNibble& other) const {
+		u64 res = ~u64(0);
+		for (u64 j = 0; j < 4; j++) {
+			res &= ~(bits[j] ^ other.bits[j]);
+		}
+		return res;
+	}
+
+	u64 less(const LaneNibble& other) const {
+		u64 res = 0;
+		u64 eq  = ~u64(0);
+		for (u64 j = 4; j-- > 0;) {
+			res |= eq & ~bits[j] & other.bits[j];
+			eq  &= ~(bits[j] ^ other.bits[j]);
+		}
+		return res;
+	}
+};
+
+/**
+ * @brief Bit-sliced simulator of 64 independent games (lanes) on the same board.
+ * Every cell keeps a u64 per plane, bit k of it is the cell in game k,
+ * so one word operation advances all lanes.
+ *
+ * Round (as in karol.cpp rollouts): bullets move, both players choose a random
+ * not stupid move (uniformly, per lane), shots are fired, players move
+ * (with wall / collision rules), players standing on bullets are hit.
+ * Bullets that are the same in all lanes (e.g. from the input) are given per round
+ * as a Bitboard, planes hold only bullets shot during the simulation.
+ */
+template <u64 N, u64 M>
+struct LaneSim {
+	using Board = Bitboard<N, M>;
+
+	static constexpr u64 CELLS = N * M;
+	// padding, so that cell +- M is always inside arrays
+	static constexpr u64 PAD = M;
+	static constexpr std::array<i64, 4> SHIFT = {-i64(M), i64(M), -1, 1};
+
+	using Plane = std::array<u64, CELLS + 2 * PAD>;
+
+	// all ones in cells whose neighbour in the direction is a wall:
+	std::array<Plane, 4> blocked;
+
+	// bullets of this round are bullet_buffers[current], the other one is for the next round
+	std::array<std::array<Plane, 4>, 2> bullet_buffers;
+	u64 current = 0;
+	// all bullets of the current round
+	Plane occupied;
+
+	/**
+	 * @brief One-hot positions of a player: plane plus the list of its nonzero cells
+	 * (at most one per lane), so players never need a scan of the whole board.
+	 */
+	struct Player {
+		Plane plane;
+		std::array<uint16_t, 64> cells;
+		u64 count = 0;
+
+		void place(u64 cell) {
+			for (u64 k = 0; k < count; k++) {
+				plane[cells[k]] = 0;
+			}
+			plane[cell + PAD] = ~u64(0);
+			cells[0] = cell + PAD;
+			count = 1;
+		}
+	};
+
+	std::array<Player, 4> players;
+	Player* hero  = &players[0];
+	Player* enemy = &players[1];
+	// positions before the last walk, used to undo collisions
+	Player* old_hero  = &players[2];
+	Player* old_enemy = &players[3];
+
+	// lanes where the player was hit (at any round so far)
+	u64 hero_hit  = 0;
+	u64 enemy_hit = 0;
+
+	LaneRng rng;
+
+	LaneSim() {
+		for (auto& player: players) {
+			player.plane.fill(0);
+		}
+	}
+
+	// players point into this object
+	LaneSim(const LaneSim&) = delete;
+	LaneSim& operator=(const LaneSim&) = delete;
+
+	void setWalls(const Board& walls) {
+		for (u64 dir = 0; dir < 4; dir++) {
+			blocked[dir].fill(0);
+			const Board blocked_board = walls.shifted(-SHIFT[dir]);
+			blocked_board.forEach([&](u64 cell) { blocked[dir][cell + PAD] = ~u64(0); });
+		}
+	}
+
+	/**
+	 * @param spawned bullets (same for all lanes) kept in planes
+	 */
+	void reset(u64 hero_cell, u64 enemy_cell, const std::array<Board, 4>& spawned) {
+		auto& bullets = bullet_buffers[current];
+		for (u64 dir = 0; dir < 4; dir++) {
+			bullets[dir].fill(0);
+			spawned[dir].forEach([&](u64 cell) { bullets[dir][cell + PAD] = ~u64(0); });
+		}
+		hero->place(hero_cell);
+		enemy->place(enemy_cell);
+		hero_hit  = 0;
+		enemy_hit = 0;
+	}
+
+	u64 finished() const {
+		return hero_hit | enemy_hit;
+	}
+
+	void moveBullets(const Board& static_bullets) {
+		const auto& bullets = bullet_buffers[current];
+		auto& next_bullets  = bullet_buffers[current ^ 1];
+		for (u64 dir = 0; dir < 4; dir++) {
+			const i64 shift = SHIFT[dir];
+			const auto& from    = bullets[dir];
+			const auto& from_bl = blocked[dir];
+			const auto& back    = bullets[dir ^ 1];
+			const auto& back_bl = blocked[dir ^ 1];
+			auto& to = next_bullets[dir];
+			for (u64 c = PAD; c < PAD + CELLS; c++) {
+				to[c] = (from[c - shift] & ~from_bl[c - shift]) | (back[c] & back_bl[c]);
+			}
+		}
+		current ^= 1;
+
+		for (u64 c = PAD; c < PAD + CELLS; c++) {
+			occupied[c] = next_bullets[0][c] | next_bullets[1][c] | next_bullets[2][c] | next_bullets[3][c];
+		}
+		static_bullets.forEach([&](u64 cell) { occupied[cell + PAD] = ~u64(0); });
+	}
+
+	/**
+	 * @brief Not stupid moves (as in karol.cpp) of the player in every lane.
+	 * @return mask of lanes for every move
+	 */
+	std::array<u64, 9> legalMoves(const Player& player) const {
+		u64 here = 0;
+		std::array<u64, 4> wall_next   = {0, 0, 0, 0};
+		std::array<u64, 4> bullet_next = {0, 0, 0, 0};
+		for (u64 k = 0; k < player.count; k++) {
+			const u64 c = player.cells[k];
+			const u64 p = player.plane[c];
+			here |= p & occupied[c];
+			for (u64 dir = 0; dir < 4; dir++) {
+				wall_next[dir]   |= p & blocked[dir][c];
+				bullet_next[dir] |= p & occupied[c + SHIFT[dir]];
+			}
+		}
+
+		std::array<u64, 9> res;
+		for (u64 dir = 0; dir < 4; dir++) {
+			res[dir]     = ~wall_next[dir] & ~bullet_next[dir];
+			res[dir + 4] = ~wall_next[dir] & ~here;
+		}
+		res[8] = ~here;
+		return res;
+	}
+
+	/**
+	 * @brief Picks, in every lane, one of the legal moves uniformly at random.
+	 * Lanes without legal moves wait.
+	 */
+	std::array<u64, 9> chooseMoves(const std::array<u64, 9>& legal) {
+		LaneNibble count;
+		for (u64 k = 0; k < 9; k++) {
+			count.increment(legal[k]);
+		}
+
+		// draw as few random bits as needed, so at least half of the draws are accepted:
+		const u64 width_mask[4] = {
+			LaneNibble::constant(1).less(count),
+			LaneNibble::constant(2).less(count),
+			LaneNibble::constant(4).less(count),
+			LaneNibble::constant(8).less(count),
+		};
+
+		// index of the chosen legal move:
+		LaneNibble index;
+		u64 undecided = ~u64(0);
+		for (u64 iter = 0; iter < 16 and undecided != 0; iter++) {
+			LaneNibble r;
+			for (u64 j = 0; j < 4; j++) {
+				r.bits[j] = rng() & width_mask[j];
+			}
+			const u64 accepted = r.less(count) & undecided;
+			for (u64 j = 0; j < 4; j++) {
+				index.bits[j] |= r.bits[j] & accepted;
+			}
+			undecided &= ~accepted;
+		}
+		// unlucky lanes take the first legal move (index is 0 there)
+
+		std::array<u64, 9> res;
+		LaneNibble seen;
+		u64 any = 0;
+		for (u64 k = 0; k < 9; k++) {
+			res[k] = legal[k] & seen.equal(index);
+			seen.increment(legal[k]);
+			any |= res[k];
+		}
+		res[8] |= ~any;
+		return res;
+	}
+
+	static std::array<u64, 9> forcedMove(u64 move) {
+		std::array<u64, 9> res = {};
+		res[move] = ~u64(0);
+		return res;
+	}
+
+	void shoot(const Player& player, const std::array<u64, 9>& moves) {
+		auto& bullets = bullet_buffers[current];
+		for (u64 k = 0; k < player.count; k++) {
+			const u64 c = player.cells[k];
+			const u64 p = player.plane[c];
+			for (u64 dir = 0; dir < 4; dir++) {
+				const u64 lanes = p & moves[dir + 4];
+				const u64 bl = blocked[dir][c];
+				// shot into a wall turns back at once:
+				bullets[dir ^ 1][c] |= lanes & bl;
+				bullets[dir][c + SHIFT[dir]] |= lanes & ~bl;
+				occupied[c] |= lanes & bl;
+				occupied[c + SHIFT[dir]] |= lanes & ~bl;
+			}
+		}
+	}
+
+	/**
+	 * @brief Moves the player, old positions are left in `old`.
+	 */
+	void walk(Player*& current, Player*& previous, const std::array<u64, 9>& moves) {
+		const u64 stay = ~(moves[0] | moves[1] | moves[2] | moves[3]);
+		std::swap(current, previous);
+		Player& player = *current;
+		const Player& old = *previous;
+		for (u64 k = 0; k < player.count; k++) {
+			player.plane[player.cells[k]] = 0;
+		}
+		player.count = 0;
+
+		auto add = [&](u64 cell, u64 lanes) {
+			if (lanes == 0) {
+				return;
+			}
+			if (player.plane[cell] == 0) {
+				player.cells[player.count++] = cell;
+			}
+			player.plane[cell] |= lanes;
+		};
+		for (u64 k = 0; k < old.count; k++) {
+			const u64 c = old.cells[k];
+			const u64 p = old.plane[c];
+			add(c, p & stay);
+			for (u64 dir = 0; dir < 4; dir++) {
+				add(c + SHIFT[dir], p & moves[dir]);
+			}
+		}
+	}
+
+	// rebuilds the list of cells (after collisions are undone),
+	// nonzero cells are among the current and old ones
+	static void rebuildCells(Player& player, const Player& old) {
+		const auto candidates = player.cells;
+		const u64 candidate_count = player.count;
+		player.count = 0;
+		auto add = [&](u64 c) {
+			if (player.plane[c] == 0) {
+				return;
+			}
+			for (u64 l = 0; l < player.count; l++) {
+				if (player.cells[l] == c) {
+					return;
+				}
+			}
+			player.cells[player.count++] = c;
+		};
+		for (u64 k = 0; k < candidate_count; k++) {
+			add(candidates[k]);
+		}
+		for (u64 k = 0; k < old.count; k++) {
+			add(old.cells[k]);
+		}
+	}
+
+	u64 hitLanes(const Player& player) const {
+		u64 res = 0;
+		for (u64 k = 0; k < player.count; k++) {
+			const u64 c = player.cells[k];
+			res |= player.plane[c] & occupied[c];
+		}
+		return res;
+	}
+
+	/**
+	 * @brief Plays one round in every lane.
+	 * @param hero_move forced hero move for all lanes, or -1 for random ones
+	 */
+	void step(const Board& static_bullets, i64 hero_move = -1) {
+		moveBullets(static_bullets);
+
+		const auto hero_moves  = hero_move >= 0 ? forcedMove(hero_move) : chooseMoves(legalMoves(*hero));
+		const auto enemy_moves = chooseMoves(legalMoves(*enemy));
+
+		shoot(*enemy, enemy_moves);
+		shoot(*hero, hero_moves);
+
+		walk(hero, old_hero, hero_moves);
+		walk(enemy, old_enemy, enemy_moves);
+
+		// players can't end up in the same cell -- both go back:
+		u64 collision = 0;
+		for (u64 k = 0; k < hero->count; k++) {
+			const u64 c = hero->cells[k];
+			collision |= hero->plane[c] & enemy->plane[c];
+		}
+		if (collision != 0) [[unlikely]] {
+			for (auto [player, old]: {std::pair{hero, old_hero}, std::pair{enemy, old_enemy}}) {
+				for (u64 k = 0; k < player->count; k++) {
+					player->plane[player->cells[k]] &= ~collision;
+				}
+				for (u64 k = 0; k < old->count; k++) {
+					player->plane[old->cells[k]] |= old->plane[old->cells[k]] & collision;
+				}
+				rebuildCells(*player, *old);
+			}
+		}
+
+		const u64 active = ~finished();
+		hero_hit  |= hitLanes(*hero) & active;
+		enemy_hit |= hitLanes(*enemy) & active;
+	}
+};
+
+}
@@ -0,0 +1,635 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include "bitboard.hpp"
+#include "input.hpp"
+#include "move_gen.hpp"
+
+namespace common {
+
+/**
+ * Large map mode: boards of any size (experimental maps, e.g. 256 x 256),
+ * known only at run time. Cells are flat indexes i * m + j.
+ *
+ * Bitboards are row padded: every row starts at a word boundary,
+ * so a vertical move is a whole-row word offset (no bit shifts, no carries between rows)
+ * and a horizontal move only carries between words of the same row.
+ * Bullets switch between such planes (cost ~ area) and a sorted list (cost ~ bullet count),
+ * whichever is cheaper for the current number of bullets.
+ */
+
+/**
+ * @brief Row padded set of cells of a n x m board.
+ */
+class PaddedBoard {
+public:
+	u64 n = 0;
+	u64 m = 0;
+	u64 row_words = 0;
+	std::vector<u64> words;
+
+	PaddedBoard() = default;
+
+	PaddedBoard(u64 n, u64 m)
+		: n(n), m(m), row_words((m + 63) / 64), words(n * row_words) {}
+
+	u64 wordOf(u64 cell) const {
+		return (cell / m) * row_words + (cell % m) / 64;
+	}
+
+	static u64 bitOf(u64 cell, u64 m) {
+		return u64(1) << ((cell % m) % 64);
+	}
+
+	bool test(u64 cell) const {
+		return words[wordOf(cell)] & bitOf(cell, m);
+	}
+
+	void set(u64 cell) {
+		words[wordOf(cell)] |= bitOf(cell, m);
+	}
+
+	void reset(u64 cell) {
+		words[wordOf(cell)] &= ~bitOf(cell, m);
+	}
+
+	void clear() {
+		std::fill(words.begin(), words.end(), 0);
+	}
+
+	u64 count() const {
+		u64 res = 0;
+		for (auto w: words) {
+			res += std::popcount(w);
+		}
+		return res;
+	}
+
+	template <typename F>
+	void forEach(F f) const {
+		for (u64 i = 0; i < n; i++) {
+			for (u64 w = 0; w < row_words; w++) {
+				u64 word = words[i * row_words + w];
+				while (word != 0) {
+					f(i * m + w * 64 + std::countr_zero(word));
+					word &= word - 1;
+				}
+			}
+		}
+	}
+};
+
+/**
+ * @brief Decoded referee input of any size (like ParsedInput, but with run time size).
+ * Bullets are keys 4 * cell + dir (dir is InputDir).
+ */
+struct LargeInput {
+	u64 n = 0;
+	u64 m = 0;
+	u64 round_number = 0;
+	char who = 'R';
+
+	std::vector<uint8_t> walls;
+	std::vector<uint32_t> bullets;
+
+	u64 red  = 0;
+	u64 blue = 0;
+
+	u64 time_limit_ms = 0;
+	u64 remaining_ms  = 0;
+
+	u64 heroPosition() const {
+		return who == 'R' ? red : blue;
+	}
+
+	u64 enemyPosition() const {
+		return who == 'R' ? blue : red;
+	}
+};
+
+namespace detail {
+	inline void forEachPlaneBit(const char* src, u64 cells, auto f) {
+		for (u64 w = 0; w < (cells + 63) / 64; w++) {
+			u64 word;
+			std::memcpy(&word, src + 8 * w, 8);
+			while (word != 0) {
+				f(w * 64 + std::countr_zero(word));
+				word &= word - 1;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Same formats as parseInput, without the size limit.
+ */
+inline LargeInput parseLargeInput(StdinBuffer& in) {
+	LargeInput res;
+
+	in.skipSpaces();
+	if (in.ensure(4) and std::memcmp(in.here(), BINARY_MAGIC, 4) == 0) {
+		if (not in.ensure(BINARY_HEADER_SIZE)) {
+			throw std::logic_error("Unexpected end of input");
+		}
+		uint16_t n, m;
+		uint32_t round_number, time_limit_ms, remaining_ms;
+		std::memcpy(&n, in.here() + 4, 2);
+		std::memcpy(&m, in.here() + 6, 2);
+		std::memcpy(&round_number, in.here() + 8, 4);
+		std::memcpy(&time_limit_ms, in.here() + 16, 4);
+		std::memcpy(&remaining_ms, in.here() + 20, 4);
+		res.n = n;
+		res.m = m;
+		res.round_number = round_number;
+		res.who = in.here()[12];
+		res.time_limit_ms = time_limit_ms;
+		res.remaining_ms  = remaining_ms;
+		in.advance(BINARY_HEADER_SIZE);
+
+		const u64 cells = res.n * res.m;
+		const u64 plane_size = 8 * ((cells + 63) / 64);
+		if (not in.ensure(7 * plane_size)) {
+			throw std::logic_error("Unexpected end of input");
+		}
+		const char* planes = in.here();
+		res.walls.assign(cells, 0);
+		detail::forEachPlaneBit(planes, cells, [&](u64 cell) { res.walls[cell] = 1; });
+		for (u64 dir = 0; dir < 4; dir++) {
+			detail::forEachPlaneBit(planes + (1 + dir) * plane_size, cells, [&](u64 cell) {
+				res.bullets.push_back(4 * cell + dir);
+			});
+		}
+		detail::forEachPlaneBit(planes + 5 * plane_size, cells, [&](u64 cell) { res.red = cell; });
+		detail::forEachPlaneBit(planes + 6 * plane_size, cells, [&](u64 cell) { res.blue = cell; });
+		in.advance(7 * plane_size);
+	}
+	else {
+		res.n = in.readUnsigned();
+		res.m = in.readUnsigned();
+		while (in.ensure(1) and *in.here() != '\n') {
+			in.advance(1);
+		}
+		in.advance(1);
+
+		res.walls.assign(res.n * res.m, 0);
+		const u64 row_len = 4 * res.m;
+		for (u64 i = 0; i < res.n; i++) {
+			if (not in.ensure(row_len)) {
+				throw std::logic_error("Unexpected end of input");
+			}
+			const char* row = in.here();
+			for (u64 j = 0; j < res.m; j++) {
+				const u64 cell = i * res.m + j;
+				const char* tile = row + 4 * j;
+				res.walls[cell] = tile[0] == '#';
+				if (tile[0] == 'R') {
+					res.red = cell;
+				}
+				if (tile[0] == 'B') {
+					res.blue = cell;
+				}
+				if (tile[0] == '^') {
+					res.bullets.push_back(4 * cell + INPUT_UP);
+				}
+				if (tile[1] == 'v') {
+					res.bullets.push_back(4 * cell + INPUT_DOWN);
+				}
+				if (tile[2] == '<') {
+					res.bullets.push_back(4 * cell + INPUT_LEFT);
+				}
+				if (tile[3] == '>') {
+					res.bullets.push_back(4 * cell + INPUT_RIGHT);
+				}
+			}
+			in.advance(row_len);
+			while (in.ensure(1) and *in.here() != '\n') {
+				in.advance(1);
+			}
+			in.advance(1);
+		}
+
+		res.round_number = in.readUnsigned();
+		res.who = in.readChar();
+		res.time_limit_ms = in.readUnsigned();
+		res.remaining_ms  = in.readUnsigned();
+	}
+
+	assert(res.who == 'R' or res.who == 'B');
+	std::sort(res.bullets.begin(), res.bullets.end());
+	return res;
+}
+
+/**
+ * @brief Static part of a large game (like Arena).
+ * Per direction planes are interleaved by rows: row i of direction d
+ * is at words (4 * i + d) * row_words, so a step streams through memory once
+ * and all four directions of a row are in the same few cache lines.
+ */
+class LargeArena {
+public:
+	u64 n = 0;
+	u64 m = 0;
+	u64 row_words = 0;
+	std::array<i64, 4> shift = {};
+
+	PaddedBoard walls;
+	// interleaved: cells whose neighbour in the direction is a wall
+	std::vector<u64> blocked;
+	// bit dir set if the neighbour in the direction is a wall
+	std::vector<uint8_t> wall_dirs;
+
+	LargeArena() = default;
+
+	explicit LargeArena(const LargeInput& input)
+		: n(input.n), m(input.m), row_words((input.m + 63) / 64),
+		  shift({-i64(input.m), i64(input.m), -1, 1}),
+		  walls(input.n, input.m), blocked(4 * input.n * row_words), wall_dirs(input.n * input.m) {
+
+		for (u64 cell = 0; cell < n * m; cell++) {
+			if (input.walls[cell]) {
+				walls.set(cell);
+			}
+		}
+		for (u64 i = 0; i < n; i++) {
+			for (u64 j = 0; j < m; j++) {
+				// outside of the board counts as a wall:
+				const std::array<bool, 4> wall = {
+					i == 0     or input.walls[(i - 1) * m + j],
+					i + 1 == n or input.walls[(i + 1) * m + j],
+					j == 0     or input.walls[i * m + j - 1],
+					j + 1 == m or input.walls[i * m + j + 1],
+				};
+				for (u64 dir = 0; dir < 4; dir++) {
+					if (wall[dir]) {
+						wall_dirs[i * m + j] |= 1 << dir;
+						blocked[(4 * i + dir) * row_words + j / 64] |= u64(1) << (j % 64);
+					}
+				}
+			}
+		}
+	}
+
+	u64 openDirections(u64 cell) const {
+		return ~u64(wall_dirs[cell]) & 0xf;
+	}
+
+	bool isBlocked(u64 cell, u64 dir) const {
+		return (wall_dirs[cell] >> dir) & 1;
+	}
+
+	u64 walk(u64 cell, u64 move) const {
+		if (move >= 4 or isBlocked(cell, move)) {
+			return cell;
+		}
+		return cell + shift[move];
+	}
+};
+
+/**
+ * @brief Bullets of a large game, sparse or dense:
+ * - sparse: a sorted list of cells per direction, a step costs O(bullets)
+ *   (all bullets of a list move by the same shift, so it stays sorted,
+ *   only the ones turning back move to the opposite list -- one merge),
+ * - dense: row padded planes interleaved like LargeArena::blocked, a step costs O(area / 64).
+ * Mode follows the bullet count (with hysteresis, so it does not flip every round).
+ */
+class LargeBullets {
+public:
+	// thresholds in bullets per dense word: a sparse step costs about as much per bullet
+	// as a dense one per word (measured with bench/large_map.cpp), the gap is the hysteresis
+	static constexpr double DENSE_AT  = 1.5;
+	static constexpr double SPARSE_AT = 1.0;
+
+	enum class Mode {
+		ADAPTIVE,
+		SPARSE,
+		DENSE,
+	};
+
+private:
+	u64 n = 0;
+	u64 m = 0;
+	u64 row_words = 0;
+	Mode forced = Mode::ADAPTIVE;
+	bool dense = false;
+
+	std::array<std::vector<uint32_t>, 4> sparse;
+	// reused by stepSparse:
+	std::array<std::vector<uint32_t>, 4> moved;
+	std::array<std::vector<uint32_t>, 4> turned;
+	std::vector<u64> planes;
+	std::vector<u64> next_planes;
+	u64 dense_count = 0;
+
+	u64 denseWords() const {
+		return 4 * n * row_words;
+	}
+
+	u64 planeWord(u64 cell, u64 dir) const {
+		return (4 * (cell / m) + dir) * row_words + (cell % m) / 64;
+	}
+
+	u64 sparseCount() const {
+		return sparse[0].size() + sparse[1].size() + sparse[2].size() + sparse[3].size();
+	}
+
+	void toDense() {
+		planes.assign(denseWords(), 0);
+		dense_count = sparseCount();
+		for (u64 dir = 0; dir < 4; dir++) {
+			for (auto cell: sparse[dir]) {
+				planes[planeWord(cell, dir)] |= PaddedBoard::bitOf(cell, m);
+			}
+			sparse[dir].clear();
+		}
+		dense = true;
+	}
+
+	void toSparse() {
+		// rows in order, so every list comes out sorted:
+		for (u64 i = 0; i < n; i++) {
+			for (u64 dir = 0; dir < 4; dir++) {
+				for (u64 w = 0; w < row_words; w++) {
+					u64 word = planes[(4 * i + dir) * row_words + w];
+					while (word != 0) {
+						sparse[dir].push_back(i * m + w * 64 + std::countr_zero(word));
+						word &= word - 1;
+					}
+				}
+			}
+		}
+		dense = false;
+	}
+
+	void adapt() {
+		const bool want_dense =
+			forced == Mode::DENSE or
+			(forced == Mode::ADAPTIVE and count() >= (dense ? SPARSE_AT : DENSE_AT) * denseWords());
+		if (want_dense and not dense) {
+			toDense();
+		}
+		if (not want_dense and dense) {
+			toSparse();
+		}
+	}
+
+	void stepSparse(const LargeArena& arena) {
+		for (u64 dir = 0; dir < 4; dir++) {
+			moved[dir].clear();
+			turned[dir ^ 1].clear();
+			for (auto cell: sparse[dir]) {
+				if (arena.isBlocked(cell, dir)) {
+					turned[dir ^ 1].push_back(cell);
+				}
+				else {
+					moved[dir].push_back(cell + arena.shift[dir]);
+				}
+			}
+		}
+		for (u64 dir = 0; dir < 4; dir++) {
+			sparse[dir].clear();
+			std::set_union(moved[dir].begin(), moved[dir].end(), turned[dir].begin(), turned[dir].end(),
+				std::back_inserter(sparse[dir]));
+		}
+	}
+
+	void stepDense(const LargeArena& arena) {
+		const u64 rw = row_words;
+		const u64 last_mask = m % 64 == 0 ? ~u64(0) : (u64(1) << (m % 64)) - 1;
+		next_planes.resize(planes.size());
+
+		const u64* src = planes.data();
+		const u64* blk = arena.blocked.data();
+		u64* dst = next_planes.data();
+		u64 total = 0;
+
+		auto row = [&](const u64* base, u64 i, u64 dir) { return base + (4 * i + dir) * rw; };
+
+		for (u64 i = 0; i < n; i++) {
+			const u64* up    = row(src, i, INPUT_UP);
+			const u64* down  = row(src, i, INPUT_DOWN);
+			const u64* left  = row(src, i, INPUT_LEFT);
+			const u64* right = row(src, i, INPUT_RIGHT);
+			const u64* b_up    = row(blk, i, INPUT_UP);
+			const u64* b_down  = row(blk, i, INPUT_DOWN);
+			const u64* b_left  = row(blk, i, INPUT_LEFT);
+			const u64* b_right = row(blk, i, INPUT_RIGHT);
+
+			u64* new_up    = dst + (4 * i + INPUT_UP) * rw;
+			u64* new_down  = dst + (4 * i + INPUT_DOWN) * rw;
+			u64* new_left  = dst + (4 * i + INPUT_LEFT) * rw;
+			u64* new_right = dst + (4 * i + INPUT_RIGHT) * rw;
+
+			// bullets flying up come from the row below, down -- from the row above:
+			const u64* below   = i + 1 < n ? row(src, i + 1, INPUT_UP) : nullptr;
+			const u64* b_below = i + 1 < n ? row(blk, i + 1, INPUT_UP) : nullptr;
+			const u64* above   = i > 0 ? row(src, i - 1, INPUT_DOWN) : nullptr;
+			const u64* b_above = i > 0 ? row(blk, i - 1, INPUT_DOWN) : nullptr;
+
+			for (u64 w = 0; w < rw; w++) {
+				const u64 from_below = below ? below[w] & ~b_below[w] : 0;
+				const u64 from_above = above ? above[w] & ~b_above[w] : 0;
+				new_up[w]   = from_below | (down[w] & b_down[w]);
+				new_down[w] = from_above | (up[w] & b_up[w]);
+
+				const u64 l  = left[w] & ~b_left[w];
+				const u64 l1 = w + 1 < rw ? left[w + 1] & ~b_left[w + 1] : 0;
+				new_left[w] = (l >> 1) | (l1 << 63) | (right[w] & b_right[w]);
+
+				const u64 r  = right[w] & ~b_right[w];
+				const u64 r0 = w > 0 ? right[w - 1] & ~b_right[w - 1] : 0;
+				new_right[w] = (r << 1) | (r0 >> 63) | (left[w] & b_left[w]);
+			}
+			new_right[rw - 1] &= last_mask;
+
+			for (u64 w = 0; w < rw; w++) {
+				total += std::popcount(new_up[w]) + std::popcount(new_down[w])
+					+ std::popcount(new_left[w]) + std::popcount(new_right[w]);
+			}
+		}
+
+		planes.swap(next_planes);
+		dense_count = total;
+	}
+
+public:
+	LargeBullets() = default;
+
+	/**
+	 * @param keys sorted keys 4 * cell + dir
+	 */
+	LargeBullets(u64 n, u64 m, const std::vector<uint32_t>& keys, Mode mode = Mode::ADAPTIVE)
+		: n(n), m(m), row_words((m + 63) / 64), forced(mode) {
+		for (auto key: keys) {
+			auto& list = sparse[key % 4];
+			if (list.empty() or list.back() != key / 4) {
+				list.push_back(key / 4);
+			}
+		}
+		adapt();
+	}
+
+	bool isDense() const {
+		return dense;
+	}
+
+	u64 count() const {
+		return dense ? dense_count : sparseCount();
+	}
+
+	bool test(u64 cell) const {
+		if (dense) {
+			const u64 bit = PaddedBoard::bitOf(cell, m);
+			const u64 w = planeWord(cell, 0);
+			return (planes[w] | planes[w + row_words] | planes[w + 2 * row_words] | planes[w + 3 * row_words]) & bit;
+		}
+		for (const auto& list: sparse) {
+			if (std::binary_search(list.begin(), list.end(), uint32_t(cell))) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void add(u64 cell, u64 dir) {
+		if (dense) {
+			u64& word = planes[planeWord(cell, dir)];
+			const u64 bit = PaddedBoard::bitOf(cell, m);
+			dense_count += (word & bit) == 0;
+			word |= bit;
+			return;
+		}
+		auto& list = sparse[dir];
+		auto it = std::lower_bound(list.begin(), list.end(), uint32_t(cell));
+		if (it == list.end() or *it != cell) {
+			list.insert(it, cell);
+		}
+	}
+
+	/**
+	 * @brief One round (see bulletStep), then the mode may change.
+	 */
+	void step(const LargeArena& arena) {
+		if (dense) {
+			stepDense(arena);
+		}
+		else {
+			stepSparse(arena);
+		}
+		adapt();
+	}
+
+	/**
+	 * @brief Calls f(cell, dir) for every bullet.
+	 */
+	template <typename F>
+	void forEach(F f) const {
+		if (not dense) {
+			for (u64 dir = 0; dir < 4; dir++) {
+				for (auto cell: sparse[dir]) {
+					f(u64(cell), dir);
+				}
+			}
+			return;
+		}
+		for (u64 i = 0; i < n; i++) {
+			for (u64 dir = 0; dir < 4; dir++) {
+				for (u64 w = 0; w < row_words; w++) {
+					u64 word = planes[(4 * i + dir) * row_words + w];
+					while (word != 0) {
+						f(i * m + w * 64 + std::countr_zero(word), dir);
+						word &= word - 1;
+					}
+				}
+			}
+		}
+	}
+};
+
+/**
+ * @brief GameCore for large maps: same rules and the same two-phase round.
+ */
+struct LargeGame {
+	u64 round = 0;
+	u64 hero  = 0;
+	u64 enemy = 0;
+	bool hero_hit  = false;
+	bool enemy_hit = false;
+
+	LargeBullets bullets;
+
+	static LargeGame fromInput(const LargeInput& input, LargeBullets::Mode mode = LargeBullets::Mode::ADAPTIVE) {
+		LargeGame res;
+		res.round = input.round_number;
+		res.hero  = input.heroPosition();
+		res.enemy = input.enemyPosition();
+		res.bullets = LargeBullets(input.n, input.m, input.bullets, mode);
+		return res;
+	}
+
+	bool finished() const {
+		return hero_hit or enemy_hit;
+	}
+
+	void moveBullets(const LargeArena& arena) {
+		round++;
+		bullets.step(arena);
+	}
+
+	void addBullet(const LargeArena& arena, u64 cell, u64 dir) {
+		if (arena.isBlocked(cell, dir)) {
+			dir ^= 1;
+		}
+		else {
+			cell += arena.shift[dir];
+		}
+		bullets.add(cell, dir);
+	}
+
+	void movePlayers(const LargeArena& arena, u64 hero_move, u64 enemy_move) {
+		if (4 <= enemy_move and enemy_move < 8) {
+			addBullet(arena, enemy, enemy_move - 4);
+		}
+		if (4 <= hero_move and hero_move < 8) {
+			addBullet(arena, hero, hero_move - 4);
+		}
+
+		const u64 new_hero  = arena.walk(hero, hero_move);
+		const u64 new_enemy = arena.walk(enemy, enemy_move);
+		if (new_hero != new_enemy) {
+			hero  = new_hero;
+			enemy = new_enemy;
+		}
+
+		hero_hit  = bullets.test(hero);
+		enemy_hit = bullets.test(enemy);
+	}
+
+	void step(const LargeArena& arena, u64 hero_move, u64 enemy_move) {
+		moveBullets(arena);
+		movePlayers(arena, hero_move, enemy_move);
+	}
+
+	/**
+	 * @brief See notStupidMask, call after moveBullets.
+	 */
+	MoveMask notStupidMoves(const LargeArena& arena, u64 cell) const {
+		const u64 open = arena.openDirections(cell);
+		u64 bullet_dirs = 0;
+		for (u64 dir = 0; dir < 4; dir++) {
+			bullet_dirs |= u64(((open >> dir) & 1) and bullets.test(cell + arena.shift[dir])) << dir;
+		}
+		return notStupidMask(open, bullet_dirs, bullets.test(cell));
+	}
+};
+
+}
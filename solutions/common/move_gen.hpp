@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+#include "bitboard.hpp"
+
+namespace common {
+
+/**
+ * @brief Moves are numbered as in the referee (MoveProfile):
+ * 0-3 go, 4-7 shoot (up, down, left, right), 8 wait.
+ * A set of moves is a 9 bit mask, bit k is move k -- no allocations, no lists.
+ */
+using MoveMask = uint16_t;
+
+constexpr u64 MOVE_COUNT = 9;
+constexpr u64 MOVE_WAIT  = 8;
+constexpr MoveMask WAIT_MASK = MoveMask(1) << MOVE_WAIT;
+
+using MoveOrder = std::array<uint8_t, MOVE_COUNT>;
+
+// plain index order (MOVE_ARRAY in andr729.cpp)
+constexpr MoveOrder INDEX_ORDER = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+// wait, then go and shoot for every direction (karol.cpp, random_not_stupid_moves.cpp)
+constexpr MoveOrder WAIT_FIRST_ORDER = {8, 0, 4, 1, 5, 2, 6, 3, 7};
+
+constexpr u64 moveCount(MoveMask mask) {
+	return std::popcount(mask);
+}
+
+/**
+ * @brief k-th move (from 0) of the mask, in the given order.
+ * Picking k uniformly gives a uniform move of the mask.
+ */
+constexpr u64 nthMove(MoveMask mask, const MoveOrder& order, u64 k) {
+	for (auto move: order) {
+		if ((mask >> move) & 1) {
+			if (k == 0) {
+				return move;
+			}
+			k--;
+		}
+	}
+	return MOVE_WAIT;
+}
+
+/**
+ * @brief "Not stupid" moves of a player: go only to free cells without a bullet,
+ * shoot (not into a wall) and wait only if there is no bullet on the cell.
+ * If there is no such move, it is just wait.
+ * @param open 4 bit mask of directions without a wall
+ * @param bullet_dirs 4 bit mask of directions with a bullet on the neighbour (next round)
+ * @param bullet_here bullet on the cell itself (next round)
+ */
+constexpr MoveMask notStupidMask(u64 open, u64 bullet_dirs, bool bullet_here) {
+	const u64 go = open & ~bullet_dirs;
+	const u64 stay = bullet_here ? 0 : (open << 4) | WAIT_MASK;
+	const MoveMask res = MoveMask(go | stay);
+	return res != 0 ? res : WAIT_MASK;
+}
+
+/**
+ * @brief Moves of a mask for range-for (break works as usual):
+ * `for (u64 move: MaskMoves(mask))` goes in index order (bit scan),
+ * `for (u64 move: MaskMoves(mask, order))` in the given order.
+ */
+class MaskMoves {
+private:
+	MoveMask mask;
+	const MoveOrder* order;
+
+public:
+	explicit constexpr MaskMoves(MoveMask mask, const MoveOrder* order = nullptr)
+		: mask(mask), order(order) {}
+
+	constexpr MaskMoves(MoveMask mask, const MoveOrder& order)
+		: mask(mask), order(&order) {}
+
+	class iterator {
+	private:
+		MoveMask mask;
+		const MoveOrder* order;
+		u64 position;
+
+		constexpr void skip() {
+			while (position < MOVE_COUNT and not ((mask >> (*order)[position]) & 1)) {
+				position++;
+			}
+		}
+
+	public:
+		constexpr iterator(MoveMask mask, const MoveOrder* order, u64 position)
+			: mask(mask), order(order), position(position) {
+			if (order != nullptr) {
+				skip();
+			}
+		}
+
+		constexpr u64 operator*() const {
+			return order == nullptr ? std::countr_zero(mask) : (*order)[position];
+		}
+
+		constexpr iterator& operator++() {
+			if (order == nullptr) {
+				mask &= mask - 1;
+			}
+			else {
+				position++;
+				skip();
+			}
+			return *this;
+		}
+
+		constexpr bool operator!=(const iterator& other) const {
+			return order == nullptr ? mask != other.mask : position != other.position;
+		}
+	};
+
+	constexpr iterator begin() const {
+		return {mask, order, 0};
+	}
+
+	constexpr iterator end() const {
+		return {0, order, MOVE_COUNT};
+	}
+};
+
+/**
+ * @brief Legal move masks of a player standing on a cell, computed from bitboards:
+ * which neighbours are walls (precomputed per cell) and which cells have bullets
+ * in the next round (after bullets move, i.e. when the moves take effect).
+ */
+template <u64 N, u64 M>
+class MoveGen {
+public:
+	using Board = Bitboard<N, M>;
+
+	static constexpr std::array<i64, 4> SHIFT = {-i64(M), i64(M), -1, 1};
+
+private:
+	// bit dir set if the neighbour in the direction is a wall
+	std::array<uint8_t, N * M> wall_dirs{};
+
+public:
+	MoveGen() = default;
+
+	explicit MoveGen(const Board& walls) {
+		for (u64 dir = 0; dir < 4; dir++) {
+			walls.shifted(-SHIFT[dir]).forEach([&](u64 cell) { wall_dirs[cell] |= 1 << dir; });
+		}
+	}
+
+	/**
+	 * @return 4 bit mask of directions without a wall
+	 */
+	u64 openDirections(u64 cell) const {
+		return ~u64(wall_dirs[cell]) & 0xf;
+	}
+
+	/**
+	 * @brief Moves that don't go and don't shoot into a wall, wait is always there.
+	 */
+	MoveMask wallSafe(u64 cell) const {
+		const u64 open = openDirections(cell);
+		return MoveMask(open | (open << 4)) | WAIT_MASK;
+	}
+
+	/**
+	 * @brief See notStupidMask.
+	 * @param bullets all bullets of the next round
+	 */
+	MoveMask notStupid(u64 cell, const Board& bullets) const {
+		const u64 open = openDirections(cell);
+		u64 bullet_dirs = 0;
+		for (u64 dir = 0; dir < 4; dir++) {
+			// open direction means the neighbour is on the board:
+			bullet_dirs |= u64(((open >> dir) & 1) and bullets.test(cell + SHIFT[dir])) << dir;
+		}
+		return notStupidMask(open, bullet_dirs, bullets.test(cell));
+	}
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+#include "input.hpp"
+
+namespace common {
+
+/**
+ * @brief Helpers for the referee "delta" protocol
+ * (see PROTOCOLS in python_impl/internal/runner.py).
+ */
+
+constexpr u64 mix64(u64 x) {
+	// splitmix64 finalizer
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+/**
+ * @param cell x * m + y, with m being the actual board width
+ * @param dir  0 up, 1 down, 2 left, 3 right
+ */
+constexpr u64 bulletChecksum(u64 cell, u64 dir) {
+	return mix64(1 + 4 * cell + dir);
+}
+
+constexpr u64 redChecksum(u64 cell) {
+	return mix64((u64(1) << 32) + cell);
+}
+
+constexpr u64 blueChecksum(u64 cell) {
+	return mix64((u64(2) << 32) + cell);
+}
+
+struct DeltaMessage {
+	u64 round_number;
+	u64 enemy_move;
+	u64 checksum;
+	// clock of the next move (see common::TimeManager)
+	u64 time_limit_ms;
+	u64 remaining_ms;
+};
+
+/**
+ * @brief Reads next delta line.
+ * @return false if the referee closed the input (i.e. "full" protocol).
+ */
+inline bool readDelta(StdinBuffer& in, DeltaMessage& out) {
+	in.skipSpaces();
+	if (not in.ensure(1)) {
+		return false;
+	}
+	out.round_number  = in.readUnsigned();
+	out.enemy_move    = in.readUnsigned();
+	out.checksum      = in.readUnsigned();
+	out.time_limit_ms = in.readUnsigned();
+	out.remaining_ms  = in.readUnsigned();
+	return true;
+}
+
+}
+
+/**
+ * @brief Declares the bot deterministic: its move depends only on the "full" state it gets
+ * (clock line included), so the referee may answer a repeated state from its move cache
+ * (see python_impl/internal/move_cache.py). Put it once at namespace scope.
+ */
+#define OFF_DETERMINISTIC_BOT \
+	[[gnu::used]] static const char off_deterministic_bot[] = "OFF_DETERMINISTIC_BOT"
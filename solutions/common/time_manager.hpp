@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+#include "bitboard.hpp"
+
+namespace common {
+
+/**
+ * @brief Per move time allocation.
+ * Referee sends the limit of the current move and the remaining match budget
+ * (see Game.moveClock in python_impl/internal/runner.py), 0 means unknown.
+ * Quiet positions get a fraction of the move share, tactical ones up to the hard limit.
+ * Time is measured with steady_clock from restart() (i.e. since the input arrived).
+ */
+class TimeManager {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// part of the referee limit we use -- the rest is for process start, parsing and output
+	static constexpr double LIMIT_SHARE = 0.6;
+	static constexpr u64 MARGIN_US = 10'000;
+	static constexpr u64 MIN_US = 1'000;
+
+private:
+	Clock::time_point start = Clock::now();
+	u64 default_us;
+	u64 hard_us;
+	// may be extended by the main search thread while others read it:
+	std::atomic<u64> target_us;
+
+public:
+	/**
+	 * @param default_us hard limit used when the referee does not send a clock
+	 */
+	explicit TimeManager(u64 default_us)
+		: default_us(default_us), hard_us(default_us), target_us(default_us) {}
+
+	void restart() {
+		start = Clock::now();
+	}
+
+	/**
+	 * @param moves_left expected number of our remaining moves (spreads the match budget)
+	 * @param sharpness how tactical the position is, in [0, 1] (see tacticalScore)
+	 */
+	void allocate(u64 time_limit_ms, u64 remaining_ms, u64 moves_left, double sharpness) {
+		hard_us = default_us;
+		if (time_limit_ms > 0) {
+			const u64 limit_us = u64(time_limit_ms * 1000 * LIMIT_SHARE);
+			hard_us = std::max(MIN_US, limit_us > MARGIN_US ? limit_us - MARGIN_US : 0);
+		}
+		if (remaining_ms > 0) {
+			hard_us = std::min(hard_us, std::max(MIN_US, u64(remaining_ms * 1000 * LIMIT_SHARE)));
+		}
+
+		u64 base_us = hard_us / 2;
+		if (remaining_ms > 0) {
+			base_us = std::min(base_us, remaining_ms * 1000 / std::max<u64>(moves_left, 1));
+		}
+
+		sharpness = std::clamp(sharpness, 0.0, 1.0);
+		const u64 target = u64(base_us * (0.5 + 1.5 * sharpness));
+		target_us = std::clamp(target, std::min(MIN_US, hard_us), hard_us);
+	}
+
+	/**
+	 * @brief More time when the search can't decide (at most the hard limit).
+	 */
+	void extend() {
+		target_us = std::min(hard_us, 2 * target_us.load(std::memory_order_relaxed));
+	}
+
+	u64 elapsedUs() const {
+		return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+	}
+
+	u64 allottedUs() const {
+		return target_us.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Most time a move may take (allottedUs never exceeds it).
+	 */
+	u64 hardUs() const {
+		return hard_us;
+	}
+
+	bool timeUp() const {
+		return elapsedUs() >= allottedUs();
+	}
+};
+
+/**
+ * @brief How tactical the position is, in [0, 1].
+ * Counts bullets flying at a player from at most `radius` cells away
+ * (walls are ignored) and adds a bit when players are close.
+ * @param bullets indexed with InputDir (0 up, 1 down, 2 left, 3 right)
+ */
+template <u64 N, u64 M>
+double tacticalScore(const std::array<Bitboard<N, M>, 4>& bullets, u64 hero, u64 enemy, u64 radius = 4) {
+	auto threats = [&](u64 cell) {
+		const u64 row = cell / M;
+		const u64 col = cell % M;
+		u64 res = 0;
+		for (u64 k = 1; k <= radius; k++) {
+			res += row + k < N and bullets[0].test(cell + k * M);
+			res += row >= k    and bullets[1].test(cell - k * M);
+			res += col + k < M and bullets[2].test(cell + k);
+			res += col >= k    and bullets[3].test(cell - k);
+		}
+		return res;
+	};
+
+	const u64 distance =
+		(hero / M > enemy / M ? hero / M - enemy / M : enemy / M - hero / M) +
+		(hero % M > enemy % M ? hero % M - enemy % M : enemy % M - hero % M);
+
+	double score = 0.25 * threats(hero) + 0.15 * threats(enemy);
+	if (distance <= radius) {
+		score += 0.25;
+	}
+	return std::min(score, 1.0);
+}
+
+}
@@ -1,6 +1,13 @@
 // Author: Karol
 
 #include <bits/stdc++.h>
+#include "common/bullet_timeline.hpp"
+#include "common/game.hpp"
+#include "common/input.hpp"
+#include "common/large_map.hpp"
+#include "common/lanes.hpp"
+#include "common/protocol.hpp"
+#include "common/time_manager.hpp"
 using namespace std;
 #define all(x) x.begin(), x.end()
 #define len(x) (int)x.size()
@@ -10,14 +17,33 @@ using ld = long double;
 using i128 = __int128_t;
 using pii = pair<int, int>;
 using pid = pair<int, double>;
-const long timeout = 140 * 1000;
+// time of one move when the referee does not send its clock
+const long default_timeout = 140 * 1000;
 const int max_round_num = 400;
 int max_depth = 35;
 
-long microseconds()
-{
-    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-}
+// search used by get_move, "--flat" switches to flat Monte Carlo
+bool use_duct = true;
+const int duct_pool_size = 1 << 17;
+// memory of the DUCT trees of all threads together, so they fit the sandbox limit (256 MB by default)
+const long duct_memory = 64l << 20;
+const int duct_rollout_depth = 24;
+const double duct_c = 0.7;
+// rollouts backend, "--lanes" plays 64 rollouts at once with common::LaneSim
+bool use_lanes = false;
+// "--stats" prints rollouts per second to stderr
+bool print_stats = false;
+thread_local long rollouts_done = 0;
+// rollouts of helper threads, added when they finish
+atomic<long> helper_rollouts = 0;
+// "--threads N" runs the search on N threads, each with its own rng and statistics
+int threads = 1;
+// "--iterations K" replaces the clock with K iterations per move (per thread),
+// together with one thread it gives reproducible moves (e.g. for regression tests)
+long fixed_iterations = 0;
+// "--verify K" only checks the bullet timeline and FastState against GameState
+// on K random games from the input state (see bench/verify_karol.py), exit code 1 on a mismatch
+int verify_games = 0;
 
 struct Bullet
 {
@@ -32,23 +58,48 @@ array<pii, 9> walks = {pii{-1, 0}, pii{1, 0}, pii{0, -1}, pii{0, 1},
 
 int manhat(pii a, pii b) { return abs(a.x - b.x) + abs(a.y - b.y); }
 
-mt19937 ran;
+thread_local mt19937 ran;
 char player_color = '0';
 
 map<int, char> move_codes = {{0, 'w'}, {1, 's'}, {2, 'a'}, {3, 'd'}, {4, '^'}, {5, 'v'}, {6, '<'}, {7, '>'}, {8, '_'}};
-array<array<char, 20>, 15> board;
+const int max_n = common::MAX_N, max_m = common::MAX_M;
+array<array<char, max_m>, max_n> board;
 char boardf(pii pos) { return board[pos.first][pos.second]; }
 
 int start_round = 0;
+// clock sent by the referee for the current move (0 if not sent)
+uint64_t clock_limit_ms = 0, clock_remaining_ms = 0;
 int n, m;
-vector<array<array<int, 20>, 15>> prepro_has_bullet;
+
+using Board = common::Bitboard<max_n, max_m>;
+int cell(pii pos) { return pos.x * max_m + pos.y; }
+// bullets from the input in the next rounds, from start_round
+common::BulletTimeline<max_n, max_m> timeline;
+
+// not stupid moves, fixed capacity (no allocations)
+struct MoveList
+{
+    array<int, 9> moves;
+    int count = 0;
+
+    MoveList() = default;
+    // moves of the mask in the order of GameState::get_not_stupid_moves
+    explicit MoveList(common::MoveMask mask)
+    {
+        for (auto move : common::MaskMoves(mask, common::WAIT_FIRST_ORDER))
+            push(move);
+    }
+
+    void push(int move) { moves[count++] = move; }
+    int operator[](int i) const { return moves[i]; }
+};
 
 struct GameState
 {
     int round_num;
     bool r_killed, b_killed;
 
-    array<array<int, 20>, 15> has_bullet;
+    array<array<int, max_m>, max_n> has_bullet;
     vector<Bullet> bullets;
 
     GameState()
@@ -69,7 +120,7 @@ struct GameState
         for (int x = 0; x < n; x++)
         {
             for (int y = 0; y < m; y++)
-                cerr << prepro_has_bullet[round_num - start_round][x][y] << " ";
+                cerr << timeline.hit(round_num, cell({x, y})) << " ";
             cerr << "\n";
         }
         cerr << "\n";
@@ -83,7 +134,7 @@ struct GameState
         //         return true;
         // return false;
         // cout << round_num << " " << start_round << "\n";
-        return prepro_has_bullet[round_num - start_round][pos.x][pos.y] || has_bullet[pos.x][pos.y];
+        return timeline.hit(round_num, cell(pos)) || has_bullet[pos.x][pos.y];
     }
 
     pii r_pos, b_pos;
@@ -163,39 +214,39 @@ struct GameState
         return next;
     }
 
-    pair<vector<int>, vector<int>> get_not_stupid_moves()
+    pair<MoveList, MoveList> get_not_stupid_moves()
     {
         move_bullets();
 
         bool can_shoot_a = !pos_has_bullet(r_pos),
              can_shoot_b = !pos_has_bullet(b_pos);
-        vector<int> a, b;
+        MoveList a, b;
         if (can_shoot_a)
-            a.push_back(8);
+            a.push(8);
         if (can_shoot_b)
-            b.push_back(8);
+            b.push(8);
 
         for (int ii = 0; ii < 4; ii++)
         {
             if (boardf(r_pos + walks[ii]) != '#' && !pos_has_bullet(r_pos + walks[ii]))
-                a.push_back(ii);
+                a.push(ii);
             if (boardf(b_pos + walks[ii]) != '#' && !pos_has_bullet(b_pos + walks[ii]))
-                b.push_back(ii);
+                b.push(ii);
             if (boardf(r_pos + walks[ii]) != '#' && can_shoot_a)
-                a.push_back(ii + 4);
+                a.push(ii + 4);
             if (boardf(b_pos + walks[ii]) != '#' && can_shoot_b)
-                b.push_back(ii + 4);
+                b.push(ii + 4);
         }
 
-        if (len(a) == 0)
+        if (a.count == 0)
         {
             // cerr << "It's a trap\n";
-            a = {8};
+            a.push(8);
         }
-        if (len(b) == 0)
+        if (b.count == 0)
         {
             // cerr << "Hihi haha\n";
-            b = {8};
+            b.push(8);
         }
 
         // cerr << "1:\n";
@@ -216,97 +267,348 @@ struct GameState
     pair<int, int> get_random_not_stupid_move()
     {
         auto [a, b] = get_not_stupid_moves();
-        return {a[ran() % len(a)], b[ran() % len(b)]};
+        return {a[ran() % a.count], b[ran() % b.count]};
     }
 
-    void read_board()
+    uint64_t checksum() const
     {
-        cin >> n >> m;
-        char c;
-        char P;
-
-        ignore = scanf("\n");
-        for (int i = 0; i < n; i++)
+        array<array<array<bool, 4>, max_m>, max_n> seen = {};
+        uint64_t sum = 0;
+        for (auto &bullet : bullets)
         {
-            for (int j = 0; j < 4 * m; j++)
-            {
-                ignore = scanf("%c", &c);
-                if (c == '#')
-                    board[i][j / 4] = '#';
-                else if (c == ' ' && board[i][j / 4] == 0)
-                    board[i][j / 4] = ' ';
-                else if (c == 'R')
-                    r_pos = pii{i, j / 4};
-                else if (c == 'B')
-                    b_pos = pii{i, j / 4};
-                else if (c == '^')
-                    add_bullet(Bullet{pii{i, j / 4}, 0});
-                else if (c == 'v')
-                    add_bullet(Bullet{pii{i, j / 4}, 1});
-                else if (c == '<')
-                    add_bullet(Bullet{pii{i, j / 4}, 2});
-                else if (c == '>')
-                    add_bullet(Bullet{pii{i, j / 4}, 3});
-            }
-            ignore = scanf("\n");
+            bool &s = seen[bullet.pos.x][bullet.pos.y][bullet.dir];
+            if (!s)
+                sum += common::bulletChecksum(bullet.pos.x * m + bullet.pos.y, bullet.dir);
+            s = true;
         }
+        pii red = player_color == 'B' ? b_pos : r_pos;
+        pii blue = player_color == 'B' ? r_pos : b_pos;
+        sum += common::redChecksum(red.x * m + red.y);
+        sum += common::blueChecksum(blue.x * m + blue.y);
+        return sum;
+    }
+
+    void read_board(common::StdinBuffer &in)
+    {
+        auto input = common::parseInput<max_n, max_m>(in);
+        n = input.n;
+        m = input.m;
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < m; j++)
+                board[i][j] = input.walls.test(i * max_m + j) ? '#' : ' ';
 
-        cin >> round_num;
+        for (int dir = 0; dir < 4; dir++)
+            input.bullets[dir].forEach([&](uint64_t idx)
+                                       { add_bullet(Bullet{pii(idx / max_m, idx % max_m), dir}); });
+
+        r_pos = pii(input.red / max_m, input.red % max_m);
+        b_pos = pii(input.blue / max_m, input.blue % max_m);
+
+        round_num = input.round_number;
         start_round = round_num;
+        clock_limit_ms = input.time_limit_ms;
+        clock_remaining_ms = input.remaining_ms;
 
-        cin >> P;
-        player_color = P;
-        if (P == 'B')
+        player_color = input.who;
+        if (input.who == 'B')
             swap(b_pos, r_pos);
     }
 };
 
+// walls, cells next to walls and the move generator
+common::Arena<max_n, max_m> arena;
+thread_local common::LaneSim<max_n, max_m> lanes;
+
+void prepare_bitboards()
+{
+    Board walls;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            if (board[i][j] == '#')
+                walls.set(cell({i, j}));
+    arena = common::Arena<max_n, max_m>(walls);
+    lanes.setWalls(walls);
+}
+
 void preprocess_bullets(GameState game)
 {
-    prepro_has_bullet.resize(min(max_depth, 400 - start_round) + 1);
-    for (int j = 0; j < len(prepro_has_bullet); j++)
+    // past max_round_num the referee may still play, so just look max_depth ahead
+    int depth = start_round < max_round_num ? min(max_depth, max_round_num - start_round) : max_depth;
+    prepare_bitboards();
+
+    array<Board, 4> bullets;
+    for (auto &bullet : game.bullets)
+        bullets[bullet.dir].set(cell(bullet.pos));
+    timeline.build(arena.walls, bullets, start_round, depth);
+
+}
+
+// Whether the timeline has the same frames as moving GameState bullets.
+bool verify_timeline(GameState game)
+{
+    for (int round = start_round; round <= (int)timeline.lastRound(); round++)
     {
-        prepro_has_bullet[j] = game.has_bullet;
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < m; j++)
+            {
+                if (timeline.hit(round, cell({i, j})) != (game.has_bullet[i][j] > 0))
+                    return false;
+                uint64_t first = timeline.firstHit(cell({i, j}), round);
+                if (first < (uint64_t)round || (first != timeline.NO_HIT_ROUND && !timeline.hit(first, cell({i, j}))))
+                    return false;
+            }
         game.move_bullets();
     }
+    return true;
+}
+
+// Bitboard version of GameState used in search and rollouts (common::GameCore).
+// No heap allocations, bullets are one bitboard per direction,
+// bullets from the input are read from the timeline (like in GameState).
+struct FastState : common::GameCore<max_n, max_m>
+{
+    FastState() = default;
+    explicit FastState(const GameState &state)
+    {
+        round = state.round_num;
+        hero_hit = state.r_killed;
+        enemy_hit = state.b_killed;
+        hero = cell(state.r_pos);
+        enemy = cell(state.b_pos);
+        for (auto &bullet : state.bullets)
+            bullets[bullet.dir].set(cell(bullet.pos));
+        update_occupied();
+    }
+
+    void update_occupied()
+    {
+        updateOccupied();
+        occupied |= timeline.at(round);
+    }
+
+    void move_bullets()
+    {
+        moveBullets(arena);
+        occupied |= timeline.at(round);
+    }
+
+    void move_players(int move_r, int move_b)
+    {
+        movePlayers(arena, move_r, move_b);
+    }
+
+    pair<MoveList, MoveList> get_not_stupid_moves()
+    {
+        move_bullets();
+        return {MoveList(notStupidMoves(arena, hero)), MoveList(notStupidMoves(arena, enemy))};
+    }
+
+    // same choice (and rng use) as picking from get_not_stupid_moves lists
+    pair<int, int> get_random_not_stupid_move()
+    {
+        move_bullets();
+        common::MoveMask a = notStupidMoves(arena, hero), b = notStupidMoves(arena, enemy);
+        int p_move = common::nthMove(a, common::WAIT_FIRST_ORDER, ran() % common::moveCount(a));
+        int e_move = common::nthMove(b, common::WAIT_FIRST_ORDER, ran() % common::moveCount(b));
+        return {p_move, e_move};
+    }
+};
+
+// Plays random games with GameState and FastState side by side (state without input bullets,
+// they are in the timeline). Returns number of games where they disagreed.
+int verify_fast_state(const GameState &state, int games)
+{
+    mt19937 saved = ran;
+    int horizon = timeline.lastRound();
+    int mismatches = 0;
+    for (int game = 0; game < games; game++)
+    {
+        GameState slow = state;
+        FastState fast(state);
+        while (slow.round_num < horizon)
+        {
+            mt19937 before = ran;
+            auto slow_move = slow.get_random_not_stupid_move();
+            ran = before;
+            auto fast_move = fast.get_random_not_stupid_move();
+            if (slow_move != fast_move)
+            {
+                mismatches++;
+                break;
+            }
+
+            slow.move_players(slow_move.x, slow_move.y);
+            fast.move_players(fast_move.x, fast_move.y);
+            if ((uint64_t)cell(slow.r_pos) != fast.hero || (uint64_t)cell(slow.b_pos) != fast.enemy ||
+                slow.r_killed != fast.hero_hit || slow.b_killed != fast.enemy_hit)
+            {
+                mismatches++;
+                break;
+            }
+            if (slow.r_killed || slow.b_killed)
+                break;
+        }
+    }
+    ran = saved;
+    return mismatches;
+}
+
+// Plays 64 random rollouts from the state at once (in lanes),
+// hero_move (if not -1) is the first hero move in all of them.
+// Returns number of rollouts where enemy was killed minus where we were.
+int lanes_rollout(const FastState &state, int hero_move, int horizon)
+{
+    lanes.reset(state.hero, state.enemy, state.bullets);
+    for (int round = state.round; round < horizon && ~lanes.finished() != 0; round++)
+    {
+        lanes.step(timeline.at(round + 1), round == (int)state.round ? hero_move : -1);
+    }
+    rollouts_done += 64;
+    return popcount(lanes.enemy_hit) - popcount(lanes.hero_hit);
 }
 
 string input_line;
 
-uint64_t start_time;
-int get_move(GameState state)
+common::TimeManager move_clock(default_timeout);
+
+// Spends more time when bullets fly at the players or players are close.
+void allocate_time(const GameState &game)
 {
-    vector<int> move_eval(9, -1e6);
+    array<Board, 4> bullets;
+    for (auto &bullet : game.bullets)
+        bullets[bullet.dir].set(cell(bullet.pos));
+    double sharpness = common::tacticalScore(bullets, cell(game.r_pos), cell(game.b_pos));
+    int moves_left = clamp(max_round_num - game.round_num, 10, 100);
+    move_clock.allocate(clock_limit_ms, clock_remaining_ms, moves_left, sharpness);
+}
 
-    GameState check = state;
-    vector<int> not_stupid = check.get_not_stupid_moves().x;
-    for (auto ns : not_stupid)
+// whether search should do iteration number `iteration` (clock or "--iterations")
+bool search_continues(long iteration)
+{
+    if (fixed_iterations > 0)
+        return iteration < fixed_iterations;
+    return !move_clock.timeUp();
+}
+
+// Helper threads of run_workers, started once and kept for the whole game,
+// so their thread_local search state (e.g. DUCT pool and tree) lives across moves.
+struct WorkerPool
+{
+    mutex lock;
+    condition_variable wake, done;
+    function<void(int)> job;
+    long generation = 0;
+    int busy = 0;
+    bool stop = false;
+    vector<thread> helpers;
+
+    void helper_loop(int id)
     {
-        move_eval[ns] += 1e6;
+        long seen = 0;
+        while (true)
+        {
+            function<void(int)> current;
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+                current = job;
+            }
+            ran = mt19937(10 + id * 1000 + start_round);
+            lanes.rng = common::LaneRng(10 + id * 1000 + start_round);
+            lanes.setWalls(arena.walls);
+            rollouts_done = 0;
+            current(id);
+            helper_rollouts += rollouts_done;
+            {
+                lock_guard<mutex> guard(lock);
+                busy--;
+            }
+            done.notify_one();
+        }
+    }
+
+    // starts f(id) on helpers 1..count-1, wait() returns once they all finished
+    void start(int count, function<void(int)> f)
+    {
+        while ((int)helpers.size() < count - 1)
+        {
+            int id = helpers.size() + 1;
+            helpers.emplace_back([this, id] { helper_loop(id); });
+        }
+        lock_guard<mutex> guard(lock);
+        job = std::move(f);
+        busy = count - 1;
+        generation++;
+        wake.notify_all();
+    }
+
+    void wait()
+    {
+        unique_lock<mutex> guard(lock);
+        done.wait(guard, [&] { return busy == 0; });
     }
 
+    ~WorkerPool()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto &helper : helpers)
+            helper.join();
+    }
+} worker_pool;
+
+// Runs f(worker_id) on `threads` threads, worker 0 is the calling thread.
+// Helpers get their own rng (seeded by id and round) and LaneSim.
+template <typename F>
+void run_workers(F f)
+{
+    if (threads > 1)
+        worker_pool.start(threads, [&f](int id) { f(id); });
+    f(0);
+    if (threads > 1)
+        worker_pool.wait();
+}
+
+void flat_worker(const GameState &state, const vector<int> &not_stupid, array<int, 9> &move_eval)
+{
     for (int k = 0; k < 1e6; k++)
     {
-        if (start_time + timeout < microseconds())
+        if (!search_continues(k))
         {
             // cerr << "3: " << k << "\n";
             break;
         }
+        if (use_lanes)
+        {
+            FastState root(state);
+            int horizon = min<int>(timeline.lastRound(), start_round + 23);
+            for (auto i : not_stupid)
+                move_eval[i] += lanes_rollout(root, i, horizon);
+            continue;
+        }
         for (auto i : not_stupid)
         {
-            GameState monte = state;
+            rollouts_done++;
+            FastState monte(state);
             int p_move = i;
             int e_move = monte.get_random_not_stupid_move().second;
 
-            for (int j = 0; j < 23 && monte.round_num <= max_round_num; j++)
+            for (int j = 0; j < 23 && (int)monte.round <= max_round_num; j++)
             {
                 monte.move_players(p_move, e_move);
-                if (monte.r_killed == 1)
+                if (monte.hero_hit == 1)
                     move_eval[i] -= 1;
-                if (monte.b_killed == 1)
+                if (monte.enemy_hit == 1)
                     move_eval[i] += 1;
 
-                if (monte.r_killed || monte.r_killed)
+                if (monte.hero_hit || monte.enemy_hit)
                     break;
 
                 auto [m1, m2] = monte.get_random_not_stupid_move();
@@ -315,6 +617,30 @@ int get_move(GameState state)
             }
         }
     }
+}
+
+int get_move_flat(GameState state)
+{
+    vector<int> move_eval(9, -1e6);
+
+    FastState check(state);
+    MoveList root_moves = check.get_not_stupid_moves().x;
+    vector<int> not_stupid(root_moves.moves.begin(), root_moves.moves.begin() + root_moves.count);
+    for (auto ns : not_stupid)
+    {
+        move_eval[ns] += 1e6;
+    }
+
+    // private statistics of every thread, merged at the deadline
+    vector<array<int, 9>> worker_eval(threads);
+    run_workers([&](int id)
+    {
+        worker_eval[id].fill(0);
+        flat_worker(state, not_stupid, worker_eval[id]);
+    });
+    for (auto &eval : worker_eval)
+        for (int i = 0; i < 9; i++)
+            move_eval[i] += eval[i];
 
     int opt = -1e9;
     vector<int> move;
@@ -339,24 +665,519 @@ int get_move(GameState state)
     return move[ran() % len(move)];
 }
 
-int main()
+// Decoupled UCT: in every node hero and enemy choose their actions
+// by UCB on their own statistics, without looking at the other's choice.
+// Nodes are states before bullets move, actions are not stupid moves.
+struct DuctNode
+{
+    array<int, 9> hero_moves, enemy_moves;
+    int hero_count, enemy_count;
+    bool expanded;
+
+    array<int, 9> hero_visits, enemy_visits;
+    // sums of results, each from its player's point of view
+    array<double, 9> hero_value, enemy_value;
+    int visits;
+
+    int first_child, next_sibling;
+    int hero_action, enemy_action;
+};
+
+// every thread has its own tree (root parallelization), kept between moves (see WorkerPool);
+// the pool grows with the nodes used, up to duct_pool_cap()
+thread_local vector<DuctNode> duct_pool;
+thread_local int duct_used = 0;
+thread_local int duct_root = -1;
+
+// nodes of one thread's pool: duct_memory split between the threads
+int duct_pool_cap()
+{
+    return min<long>(duct_pool_size, duct_memory / threads / sizeof(DuctNode));
+}
+
+int duct_new_node(int hero_action, int enemy_action)
+{
+    if (duct_used == duct_pool_cap())
+        return -1;
+    if (duct_used == (int)duct_pool.size())
+    {
+        if (duct_pool.size() == duct_pool.capacity())
+            duct_pool.reserve(min<size_t>(max<size_t>(2 * duct_pool.capacity(), 1024), duct_pool_cap()));
+        duct_pool.emplace_back();
+    }
+    DuctNode &node = duct_pool[duct_used];
+    node.expanded = false;
+    node.hero_visits.fill(0);
+    node.enemy_visits.fill(0);
+    node.hero_value.fill(0);
+    node.enemy_value.fill(0);
+    node.visits = 0;
+    node.first_child = node.next_sibling = -1;
+    node.hero_action = hero_action;
+    node.enemy_action = enemy_action;
+    return duct_used++;
+}
+
+void duct_reset()
 {
-    GameState game;
+    duct_used = 0;
+    duct_root = duct_new_node(-1, -1);
+}
+
+int duct_child(int parent, int hero_action, int enemy_action)
+{
+    for (int c = duct_pool[parent].first_child; c != -1; c = duct_pool[c].next_sibling)
+        if (duct_pool[c].hero_action == hero_action && duct_pool[c].enemy_action == enemy_action)
+            return c;
+    return -1;
+}
+
+int duct_select(const array<int, 9> &visits, const array<double, 9> &value, int count, int total)
+{
+    double log_total = log(max(total, 1));
+    int best = 0;
+    double best_score = -1e18;
+    for (int i = 0; i < count; i++)
+    {
+        if (visits[i] == 0)
+            return i;
+        double score = value[i] / visits[i] + duct_c * sqrt(log_total / visits[i]);
+        if (score > best_score)
+        {
+            best_score = score;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// last round for which the timeline is known and we still want to look
+int duct_horizon()
+{
+    return min<int>(timeline.lastRound(), start_round + duct_rollout_depth);
+}
+
+// +1 when enemy is killed, -1 when we are, 0 otherwise
+// (with lanes it is the average of 64 rollouts)
+double duct_rollout(FastState &state, int horizon)
+{
+    if (use_lanes)
+        return lanes_rollout(state, -1, horizon) / 64.0;
+    rollouts_done++;
+    while ((int)state.round < horizon)
+    {
+        auto [p_move, e_move] = state.get_random_not_stupid_move();
+        state.move_players(p_move, e_move);
+        if (state.hero_hit || state.enemy_hit)
+            return state.enemy_hit - state.hero_hit;
+    }
+    return 0;
+}
+
+void duct_iteration(FastState state, int horizon)
+{
+    static thread_local array<array<int, 3>, 64> path;
+    int path_len = 0;
+    double result = 0;
+
+    int node_id = duct_root;
+    while ((int)state.round < horizon)
+    {
+        DuctNode &node = duct_pool[node_id];
+        if (!node.expanded)
+        {
+            auto [a, b] = state.get_not_stupid_moves();
+            node.hero_count = a.count;
+            node.enemy_count = b.count;
+            node.hero_moves = a.moves;
+            node.enemy_moves = b.moves;
+            node.expanded = true;
+        }
+        else
+            state.move_bullets();
+
+        int hero_action = duct_select(node.hero_visits, node.hero_value, node.hero_count, node.visits);
+        int enemy_action = duct_select(node.enemy_visits, node.enemy_value, node.enemy_count, node.visits);
+        path[path_len++] = {node_id, hero_action, enemy_action};
+
+        state.move_players(node.hero_moves[hero_action], node.enemy_moves[enemy_action]);
+        if (state.hero_hit || state.enemy_hit)
+        {
+            result = state.enemy_hit - state.hero_hit;
+            break;
+        }
+
+        int child = duct_child(node_id, hero_action, enemy_action);
+        if (child == -1)
+        {
+            child = duct_new_node(hero_action, enemy_action);
+            if (child != -1)
+            {
+                // the pool may have grown, `node` is not valid any more
+                DuctNode &parent = duct_pool[node_id];
+                duct_pool[child].next_sibling = parent.first_child;
+                parent.first_child = child;
+            }
+            result = duct_rollout(state, horizon);
+            break;
+        }
+        node_id = child;
+    }
+
+    for (int i = 0; i < path_len; i++)
+    {
+        auto [id, hero_action, enemy_action] = path[i];
+        DuctNode &node = duct_pool[id];
+        node.visits++;
+        node.hero_visits[hero_action]++;
+        node.hero_value[hero_action] += result;
+        node.enemy_visits[enemy_action]++;
+        node.enemy_value[enemy_action] -= result;
+    }
+}
+
+// root statistics of one thread's tree
+struct DuctRootStats
+{
+    array<int, 9> visits{};
+    array<double, 9> value{};
+    int iterations = 0;
+    int nodes = 0;
+};
+
+// share of root visits of the most visited hero move
+double duct_root_agreement()
+{
+    const DuctNode &root = duct_pool[duct_root];
+    if (!root.expanded || root.visits == 0)
+        return 0;
+    return (double)*max_element(root.hero_visits.begin(), root.hero_visits.begin() + root.hero_count) / root.visits;
+}
+
+void duct_worker(int id, const FastState &state, int horizon, DuctRootStats &stats)
+{
+    if (duct_root == -1)
+        duct_reset();
+
+    int iterations = 0;
+    bool extended = false;
+    while (true)
+    {
+        if (!search_continues(iterations))
+        {
+            // root moves still disagree -- worth more time (main thread decides for all)
+            if (id != 0 || extended || fixed_iterations > 0 || duct_root_agreement() >= 0.5)
+                break;
+            move_clock.extend();
+            extended = true;
+            if (!search_continues(iterations))
+                break;
+        }
+        if ((int)state.round >= horizon)
+            break;
+        // check clock once per few iterations
+        for (int k = 0; k < 16; k++)
+            duct_iteration(state, horizon);
+        iterations += 16;
+    }
+
+    const DuctNode &root = duct_pool[duct_root];
+    stats.iterations = iterations;
+    stats.nodes = duct_used;
+    // root moves are the same in every tree (same state), so stats can be summed by index
+    for (int i = 0; i < root.hero_count && root.expanded; i++)
+    {
+        stats.visits[i] = root.hero_visits[i];
+        stats.value[i] = root.hero_value[i];
+    }
+}
+
+int get_move_duct(GameState slow_state)
+{
+    FastState state(slow_state);
+    int horizon = duct_horizon();
+    vector<DuctRootStats> stats(threads);
+    run_workers([&](int id) { duct_worker(id, state, horizon, stats[id]); });
+
+    MoveList root_moves = FastState(slow_state).get_not_stupid_moves().x;
+    DuctRootStats total;
+    for (auto &s : stats)
+    {
+        total.iterations += s.iterations;
+        total.nodes += s.nodes;
+        for (int i = 0; i < root_moves.count; i++)
+        {
+            total.visits[i] += s.visits[i];
+            total.value[i] += s.value[i];
+        }
+    }
+
+    int best = 0;
+    for (int i = 1; i < root_moves.count; i++)
+        if (total.visits[i] > total.visits[best])
+            best = i;
+
+#ifdef _GLIBCXX_DEBUG
+    cerr << "iterations: " << total.iterations << ", nodes: " << total.nodes << "\n";
+    for (int i = 0; i < root_moves.count; i++)
+        cerr << move_codes[root_moves[i]] << ": " << total.visits[i] << " "
+             << total.value[i] / max(total.visits[i], 1) << "\n";
+    cerr << "\n";
+#endif
+    return root_moves[best];
+}
+
+// Keeps the subtree of the played moves for the next round (delta protocol), for the calling thread.
+void duct_advance(int hero_move, int enemy_move)
+{
+    if (duct_root == -1)
+        return;
+    const DuctNode &root = duct_pool[duct_root];
+    int hero_action = -1, enemy_action = -1;
+    for (int i = 0; i < root.hero_count && root.expanded; i++)
+        if (root.hero_moves[i] == hero_move)
+            hero_action = i;
+    for (int i = 0; i < root.enemy_count && root.expanded; i++)
+        if (root.enemy_moves[i] == enemy_move)
+            enemy_action = i;
+
+    int child = hero_action == -1 || enemy_action == -1 ? -1 : duct_child(duct_root, hero_action, enemy_action);
+    // not worth keeping a tree that would fill the pool soon
+    duct_root = duct_used < duct_pool_cap() / 2 ? child : -1;
+}
+
+int get_move(GameState state)
+{
+#ifdef _GLIBCXX_DEBUG
+    assert(verify_fast_state(state, 50) == 0);
+#endif
+    rollouts_done = 0;
+    helper_rollouts = 0;
+    int move = use_duct ? get_move_duct(state) : get_move_flat(state);
+    if (print_stats)
+    {
+        long elapsed = max<long>(1, move_clock.elapsedUs());
+        long total = rollouts_done + helper_rollouts;
+        cerr << "rollouts: " << total << " (" << total * 1000000 / elapsed << "/s)\n";
+    }
+    return move;
+}
+
+// Large map mode (boards bigger than max_n x max_m, common/large_map.hpp):
+// flat Monte Carlo on LargeGame, which is kept between rounds with delta protocol.
+common::LargeArena large_arena;
+
+uint64_t large_checksum(const common::LargeGame &game)
+{
+    uint64_t sum = 0;
+    game.bullets.forEach([&](uint64_t cell, uint64_t dir) { sum += common::bulletChecksum(cell, dir); });
+    bool red = player_color == 'R';
+    sum += common::redChecksum(red ? game.hero : game.enemy);
+    sum += common::blueChecksum(red ? game.enemy : game.hero);
+    return sum;
+}
+
+int random_not_stupid_large(const common::LargeGame &game, uint64_t cell)
+{
+    common::MoveMask moves = game.notStupidMoves(large_arena, cell);
+    return common::nthMove(moves, common::WAIT_FIRST_ORDER, ran() % common::moveCount(moves));
+}
+
+// state: after moveBullets of the round we play
+void flat_worker_large(const common::LargeGame &state, common::MoveMask root_moves, array<int, 9> &move_eval)
+{
+    for (long k = 0; search_continues(k); k++)
+    {
+        for (uint64_t i : common::MaskMoves(root_moves))
+        {
+            rollouts_done++;
+            common::LargeGame monte = state;
+            int p_move = i;
+            int e_move = random_not_stupid_large(monte, monte.enemy);
+
+            for (int j = 0; j < 23 && (int)monte.round <= max_round_num; j++)
+            {
+                monte.movePlayers(large_arena, p_move, e_move);
+                if (monte.hero_hit)
+                    move_eval[i] -= 1;
+                if (monte.enemy_hit)
+                    move_eval[i] += 1;
+                if (monte.finished())
+                    break;
+
+                monte.moveBullets(large_arena);
+                p_move = random_not_stupid_large(monte, monte.hero);
+                e_move = random_not_stupid_large(monte, monte.enemy);
+            }
+        }
+    }
+}
+
+int get_move_large(common::LargeGame state)
+{
+    // no tactical score here (it works on bitboards), so every move gets the same share
+    int moves_left = clamp(max_round_num - (int)state.round, 10, 100);
+    move_clock.allocate(clock_limit_ms, clock_remaining_ms, moves_left, 0.5);
+
+    state.moveBullets(large_arena);
+    common::MoveMask root_moves = state.notStupidMoves(large_arena, state.hero);
+
+    rollouts_done = 0;
+    helper_rollouts = 0;
+    vector<array<int, 9>> worker_eval(threads);
+    run_workers([&](int id)
+    {
+        worker_eval[id].fill(0);
+        flat_worker_large(state, root_moves, worker_eval[id]);
+    });
+    if (print_stats)
+    {
+        long elapsed = max<long>(1, move_clock.elapsedUs());
+        long total = rollouts_done + helper_rollouts;
+        cerr << "rollouts: " << total << " (" << total * 1000000 / elapsed << "/s)\n";
+    }
+
+    int best = -1;
+    long best_eval = 0;
+    for (uint64_t i : common::MaskMoves(root_moves, common::WAIT_FIRST_ORDER))
+    {
+        long eval = 0;
+        for (auto &worker : worker_eval)
+            eval += worker[i];
+        if (best == -1 || eval > best_eval)
+        {
+            best = i;
+            best_eval = eval;
+        }
+    }
+    return best;
+}
+
+void play_large(common::StdinBuffer &in)
+{
+    common::LargeGame tracked;
+    auto read_large = [&]()
+    {
+        auto input = common::parseLargeInput(in);
+        large_arena = common::LargeArena(input);
+        tracked = common::LargeGame::fromInput(input);
+        player_color = input.who;
+        start_round = input.round_number;
+        clock_limit_ms = input.time_limit_ms;
+        clock_remaining_ms = input.remaining_ms;
+    };
+
+    read_large();
+    while (true)
+    {
+        start_round = tracked.round;
+        int move = get_move_large(tracked);
+        cout << move << endl;
+
+        common::DeltaMessage delta;
+        if (!common::readDelta(in, delta))
+            break;
+        move_clock.restart();
+        clock_limit_ms = delta.time_limit_ms;
+        clock_remaining_ms = delta.remaining_ms;
+
+        tracked.step(large_arena, move, delta.enemy_move);
+        if (tracked.round != delta.round_number || large_checksum(tracked) != delta.checksum)
+        {
+            cout << "resync" << endl;
+            read_large();
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--flat")
+            use_duct = false;
+        if (arg == "--lanes")
+            use_lanes = true;
+        if (arg == "--stats")
+            print_stats = true;
+        if (arg == "--threads" && i + 1 < argc)
+            threads = max(1, atoi(argv[++i]));
+        if (arg == "--iterations" && i + 1 < argc)
+            fixed_iterations = atol(argv[++i]);
+        if (arg == "--verify" && i + 1 < argc)
+            verify_games = max(1, atoi(argv[++i]));
+    }
+
+    common::StdinBuffer in;
+    // full state, kept between rounds when referee uses delta protocol
+    GameState tracked;
 
-    start_time = microseconds();
     ran = mt19937(10);
 
-    game.read_board();
-    preprocess_bullets(game);
-    for(auto &b : game.has_bullet)
-        b.fill(0);
-    game.bullets.clear();
+    auto size = common::peekBoardSize(in);
+    if (size.n > max_n || size.m > max_m)
+    {
+        play_large(in);
+        return 0;
+    }
+
+    tracked.read_board(in);
+    while (true)
+    {
+        GameState game = tracked;
+        start_round = game.round_num;
+        allocate_time(game);
+        preprocess_bullets(game);
+#ifdef _GLIBCXX_DEBUG
+        assert(verify_timeline(game));
+#endif
+        if (verify_games > 0)
+        {
+            bool timeline_ok = verify_timeline(game);
+            for (auto &b : game.has_bullet)
+                b.fill(0);
+            game.bullets.clear();
+            int mismatches = verify_fast_state(game, verify_games);
+            cout << "timeline " << (timeline_ok ? "ok" : "MISMATCH") << ", fast state: "
+                 << mismatches << " mismatches in " << verify_games << " games" << endl;
+            return timeline_ok && mismatches == 0 ? 0 : 1;
+        }
+        for(auto &b : game.has_bullet)
+            b.fill(0);
+        game.bullets.clear();
 
-    int move = get_move(game);
-    cout << move << "\n";
+        int move = get_move(game);
+        cout << move << endl;
 #ifdef _GLIBCXX_DEBUG
-    cerr << player_color << ": " << move_codes[move] << "\n";
+        cerr << player_color << ": " << move_codes[move] << "\n";
 #endif
+
+        common::DeltaMessage delta;
+        if (!common::readDelta(in, delta))
+            break;
+        move_clock.restart();
+        clock_limit_ms = delta.time_limit_ms;
+        clock_remaining_ms = delta.remaining_ms;
+
+        tracked.move_bullets();
+        tracked.move_players(move, delta.enemy_move);
+        bool in_sync = tracked.round_num == (int)delta.round_number && tracked.checksum() == delta.checksum;
+        // every thread keeps its own tree
+        run_workers([&](int)
+        {
+            if (in_sync)
+                duct_advance(move, delta.enemy_move);
+            else
+                duct_root = -1;
+        });
+        if (!in_sync)
+        {
+            cout << "resync" << endl;
+            tracked = GameState();
+            tracked.read_board(in);
+        }
+    }
 }
 
 /*
@@ -1,4 +1,6 @@
 #include <bits/stdc++.h>
+#include "common/game.hpp"
+#include "common/large_map.hpp"
 using namespace std;
 #define all(x) x.begin(), x.end()
 #define len(x) (int)x.size()
@@ -16,17 +18,6 @@ long get_time_in_microseconds()
     return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
 }
 
-struct Bullet
-{
-    pii pos;
-    int dir;
-};
-
-pii operator+(pii a, pii b) { return {a.first + b.first, a.second + b.second}; }
-
-array<pii, 9> walks = {pii{-1, 0}, pii{1, 0}, pii{0, -1}, pii{0, 1},
-                       pii{0, 0}, pii{0, 0}, pii{0, 0}, pii{0, 0}, pii{0, 0}};
-
 int manhat(pii a, pii b) { return abs(a.x - b.x) + abs(a.y - b.y); }
 
 const int max_round_num = 400;
@@ -35,209 +26,67 @@ char player_color = '0';
 uint64_t start_time;
 
 map<int, char> move_codes = {{0, 'w'}, {1, 's'}, {2, 'a'}, {3, 'd'}, {4, '^'}, {5, 'v'}, {6, '<'}, {7, '>'}, {8, '_'}};
-array<array<char, 20>, 15> board;
-char boardf(pii pos) { return board[pos.first][pos.second]; }
+const int max_n = common::MAX_N, max_m = common::MAX_M;
+using GameState = common::GameCore<max_n, max_m>;
+common::Arena<max_n, max_m> arena;
 
 int start_round = 0;
 int n, m;
 
-struct GameState
+GameState read_board(common::StdinBuffer &in)
 {
-    int round_num;
-    bool p_killed, e_killed;
-
-    array<array<int, 20>, 15> has_bullet;
-    vector<Bullet> bullets;
-
-    GameState()
-    {
-        for (auto &h : has_bullet)
-            h.fill(0);
-    }
-
-    bool pos_has_bullet(pii pos) const
-    {
-        return has_bullet[pos.x][pos.y];
-    }
-
-    pii p_pos, e_pos;
-
-    void move_bullet(int i)
-    {
-        Bullet &bullet = bullets[i];
-        has_bullet[bullet.pos.x][bullet.pos.y]--;
-        if (boardf(bullet.pos + walks[bullet.dir]) == '#')
-            bullet.dir ^= 1;
-        else
-            bullet.pos = bullet.pos + walks[bullet.dir];
-        has_bullet[bullet.pos.x][bullet.pos.y]++;
-    }
-    void add_bullet(Bullet bullet)
-    {
-        bullets.push_back(bullet);
-        has_bullet[bullet.pos.x][bullet.pos.y]++;
-    }
-    void move_bullets()
-    {
-        round_num++;
-        for (int i = 0; i < len(bullets); i++)
-            move_bullet(i);
-    }
-
-    void move_players(int move_p, int move_e)
-    {
-        Bullet p_bullet, e_bullet;
-
-        if (4 <= move_e && move_e < 8)
-        {
-            e_bullet.pos = e_pos;
-            e_bullet.dir = move_e - 4;
-            if (boardf(e_bullet.pos + walks[e_bullet.dir]) == '#')
-                e_bullet.dir ^= 1;
-            else
-                e_bullet.pos = e_bullet.pos + walks[e_bullet.dir];
-            add_bullet(e_bullet);
-        }
-        if (4 <= move_p && move_p < 8)
-        {
-            p_bullet.pos = p_pos;
-            p_bullet.dir = move_p - 4;
-            if (boardf(p_bullet.pos + walks[p_bullet.dir]) == '#')
-                p_bullet.dir ^= 1;
-            else
-                p_bullet.pos = p_bullet.pos + walks[p_bullet.dir];
-            add_bullet(p_bullet);
-        }
-        pii np_pos = p_pos + walks[move_p];
-        pii ne_pos = e_pos + walks[move_e];
-
-        if (boardf(ne_pos) == '#')
-            ne_pos = e_pos;
-        if (boardf(np_pos) == '#')
-            np_pos = p_pos;
-
-        if (np_pos == ne_pos)
-        {
-            np_pos = p_pos;
-            ne_pos = e_pos;
-        }
-
-        p_pos = np_pos;
-        e_pos = ne_pos;
-        p_killed = pos_has_bullet(p_pos);
-        e_killed = pos_has_bullet(e_pos);
-    }
-
-    GameState next_board(int move_p, int move_e) const
-    {
-        GameState next = *this;
-        next.move_bullets();
-        next.move_players(move_p, move_e);
-        return next;
-    }
-
-    pair<vector<int>, vector<int>> get_not_stupid_moves_and_update_board()
-    {
-        move_bullets();
-
-        bool can_shoot_p = !pos_has_bullet(p_pos),
-             can_shoot_e = !pos_has_bullet(e_pos);
-        vector<int> p_moves, e_moves;
-        p_moves.reserve(9);
-        e_moves.reserve(9);
-        if (can_shoot_p)
-            p_moves.push_back(8);
-        if (can_shoot_e)
-            e_moves.push_back(8);
-
-        for (int ii = 0; ii < 4; ii++)
-        {
-            if (boardf(p_pos + walks[ii]) != '#' && !pos_has_bullet(p_pos + walks[ii]))
-                p_moves.push_back(ii);
-            if (boardf(e_pos + walks[ii]) != '#' && !pos_has_bullet(e_pos + walks[ii]))
-                e_moves.push_back(ii);
-            if (boardf(p_pos + walks[ii]) != '#' && can_shoot_p)
-                p_moves.push_back(ii + 4);
-            if (boardf(e_pos + walks[ii]) != '#' && can_shoot_e)
-                e_moves.push_back(ii + 4);
-        }
-
-        if (len(p_moves) == 0)
-        {
-            // cerr << "It's p_moves trap\n";
-            p_moves = {8};
-        }
-        if (len(e_moves) == 0)
-        {
-            // cerr << "Hihi haha\n";
-            e_moves = {8};
-        }
-
-        return {p_moves, e_moves};
-    }
-    pair<int, int> get_random_not_stupid_move()
-    {
-        auto [p, e] = get_not_stupid_moves_and_update_board();
-        return {p[ran() % len(p)], e[ran() % len(e)]};
-    }
-
-    void read_board()
-    {
-        cin >> n >> m;
-        char c;
-        char P;
-
-        ignore = scanf("\n");
-        for (int i = 0; i < n; i++)
-        {
-            for (int j = 0; j < 4 * m; j++)
-            {
-                ignore = scanf("%c", &c);
-                if (c == '#')
-                    board[i][j / 4] = '#';
-                else if (c == ' ' && board[i][j / 4] == 0)
-                    board[i][j / 4] = ' ';
-                else if (c == 'R')
-                    p_pos = pii{i, j / 4};
-                else if (c == 'B')
-                    e_pos = pii{i, j / 4};
-                else if (c == '^')
-                    add_bullet(Bullet{pii{i, j / 4}, 0});
-                else if (c == 'v')
-                    add_bullet(Bullet{pii{i, j / 4}, 1});
-                else if (c == '<')
-                    add_bullet(Bullet{pii{i, j / 4}, 2});
-                else if (c == '>')
-                    add_bullet(Bullet{pii{i, j / 4}, 3});
-            }
-            ignore = scanf("\n");
-        }
-
-        cin >> round_num;
-        start_round = round_num;
+    auto input = common::parseInput<max_n, max_m>(in);
+    n = input.n;
+    m = input.m;
+    arena = common::Arena<max_n, max_m>(input.walls);
+
+    start_round = input.round_number;
+    player_color = input.who;
+    return GameState::fromInput(input);
+}
 
-        cin >> P;
-        player_color = P;
-        if (P == 'B')
-            swap(e_pos, p_pos);
-    }
-};
+pair<int, int> get_random_not_stupid_move(GameState &state)
+{
+    state.moveBullets(arena);
+    common::MoveMask p = state.notStupidMoves(arena, state.hero), e = state.notStupidMoves(arena, state.enemy);
+    int move_p = common::nthMove(p, common::WAIT_FIRST_ORDER, ran() % common::moveCount(p));
+    int move_e = common::nthMove(e, common::WAIT_FIRST_ORDER, ran() % common::moveCount(e));
+    return {move_p, move_e};
+}
 
 int get_move(GameState state)
 {
-    return state.get_random_not_stupid_move().x;
+    return get_random_not_stupid_move(state).x;
 }
 
-int main()
+// boards bigger than max_n x max_m (common/large_map.hpp)
+int get_move_large(common::StdinBuffer &in)
 {
-    GameState game;
+    auto input = common::parseLargeInput(in);
+    n = input.n;
+    m = input.m;
+    start_round = input.round_number;
+    player_color = input.who;
+
+    common::LargeArena large_arena(input);
+    auto state = common::LargeGame::fromInput(input);
+    state.moveBullets(large_arena);
+    common::MoveMask p = state.notStupidMoves(large_arena, state.hero);
+    return common::nthMove(p, common::WAIT_FIRST_ORDER, ran() % common::moveCount(p));
+}
 
+int main()
+{
     start_time = get_time_in_microseconds();
     ran = mt19937(start_time);
 
-    game.read_board();
-
-    int move = get_move(game);
+    common::StdinBuffer in;
+    auto size = common::peekBoardSize(in);
+    int move;
+    if (size.n > max_n || size.m > max_m)
+        move = get_move_large(in);
+    else
+        move = get_move(read_board(in));
     cout << move << "\n";
 
 #ifdef _GLIBCXX_DEBUG